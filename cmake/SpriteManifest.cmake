@@ -0,0 +1,90 @@
+# Compiles data/sprites/<character>/<spritesheet>.ini files into a C source
+# file, together with frame sizes taken from the PNG headers, so spritesheets
+# can be set up without parsing anything at runtime.
+#
+# Usage: cmake -DDATA_DIR=<data directory> -DOUTPUT=<file.c> -P SpriteManifest.cmake
+
+function(hex_to_dec HEX RESULT)
+  set(VALUE 0)
+  string(LENGTH ${HEX} LENGTH)
+  math(EXPR LAST "${LENGTH} - 1")
+  foreach(I RANGE ${LAST})
+    string(SUBSTRING ${HEX} ${I} 1 DIGIT)
+    string(FIND "0123456789abcdef" ${DIGIT} DIGIT)
+    math(EXPR VALUE "${VALUE} * 16 + ${DIGIT}")
+  endforeach(I)
+  set(${RESULT} ${VALUE} PARENT_SCOPE)
+endfunction(hex_to_dec)
+
+# the runtime looks entries up with bsearch comparing character, then name;
+# joining them with a character lower than any in file names sorts the same way
+string(ASCII 1 SEPARATOR)
+file(GLOB FILES RELATIVE ${DATA_DIR}/sprites ${DATA_DIR}/sprites/*/*.ini)
+set(KEYS "")
+foreach(FILE ${FILES})
+  get_filename_component(CHARACTER ${FILE} PATH)
+  get_filename_component(NAME ${FILE} NAME_WE)
+  list(APPEND KEYS "${CHARACTER}${SEPARATOR}${NAME}")
+endforeach(FILE)
+list(SORT KEYS)
+
+set(FRAMES "")
+set(ENTRIES "")
+set(COUNT 0)
+foreach(KEY ${KEYS})
+  string(REPLACE ${SEPARATOR} ";" KEY ${KEY})
+  list(GET KEY 0 CHARACTER)
+  list(GET KEY 1 NAME)
+  set(CONFIG ${CHARACTER}/${NAME}.ini)
+  string(MAKE_C_IDENTIFIER "frames_${CHARACTER}_${NAME}" SYMBOL)
+
+  set(rows 1)
+  set(cols 1)
+  set(blanks 0)
+  set(delay 0)
+  set(kill 0)
+  set(successor "")
+  file(STRINGS ${DATA_DIR}/sprites/${CONFIG} LINES)
+  foreach(LINE ${LINES})
+    if(LINE MATCHES "^[ \t]*(rows|cols|blanks|delay|kill|successor)[ \t]*=[ \t]*([^ \t]*)")
+      set(${CMAKE_MATCH_1} ${CMAKE_MATCH_2})
+    endif()
+  endforeach(LINE)
+
+  # width and height are the first fields of the IHDR chunk
+  file(READ ${DATA_DIR}/sprites/${CHARACTER}/${NAME}.png HEADER OFFSET 16 LIMIT 8 HEX)
+  string(SUBSTRING ${HEADER} 0 8 WIDTH)
+  string(SUBSTRING ${HEADER} 8 8 HEIGHT)
+  hex_to_dec(${WIDTH} WIDTH)
+  hex_to_dec(${HEIGHT} HEIGHT)
+  math(EXPR WIDTH "${WIDTH} / ${cols}")
+  math(EXPR HEIGHT "${HEIGHT} / ${rows}")
+
+  math(EXPR FRAME_COUNT "${rows} * ${cols} - ${blanks}")
+  math(EXPR LAST "${FRAME_COUNT} - 1")
+  set(FRAMES "${FRAMES}static const struct SpriteFrame ${SYMBOL}[] = {\n")
+  foreach(POS RANGE ${LAST})
+    math(EXPR X "(${POS} % ${cols}) * ${WIDTH}")
+    math(EXPR Y "(${POS} / ${cols}) * ${HEIGHT}")
+    set(FRAMES "${FRAMES}\t{ ${X}, ${Y}, ${WIDTH}, ${HEIGHT} },\n")
+  endforeach(POS)
+  set(FRAMES "${FRAMES}};\n")
+
+  if(kill)
+    set(kill true)
+  else()
+    set(kill false)
+  endif()
+  if(successor)
+    set(successor "\"${successor}\"")
+  else()
+    set(successor NULL)
+  endif()
+  set(ENTRIES "${ENTRIES}\t{ \"${CHARACTER}\", \"${NAME}\", ${rows}, ${cols}, ${blanks}, ${delay}, ${kill}, ${successor}, ${WIDTH}, ${HEIGHT}, ${FRAME_COUNT}, ${SYMBOL} },\n")
+  math(EXPR COUNT "${COUNT} + 1")
+endforeach(KEY)
+
+file(WRITE ${OUTPUT}.tmp "/* Generated by SpriteManifest.cmake from data/sprites, do not edit. */\n\n#include \"spritemanifest.h\"\n\n${FRAMES}\nconst struct SpriteManifestEntry sprite_manifest[] = {\n${ENTRIES}};\n\nconst int sprite_manifest_count = ${COUNT};\n")
+# don't touch the output when nothing changed to avoid needless rebuilds
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different ${OUTPUT}.tmp ${OUTPUT})
+file(REMOVE ${OUTPUT}.tmp)
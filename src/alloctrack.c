@@ -0,0 +1,218 @@
+/*! \file alloctrack.c
+ *  \brief Finding heap allocations made while running frames.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <execinfo.h>
+#include <unistd.h>
+#include "common.h"
+#include <libsuperderpy.h>
+
+#ifndef __GLIBC__
+#error "The allocation tracker replaces glibc's malloc, turn ALLOC_TRACKER off on this platform."
+#endif
+
+// glibc's own allocator, which the replacements below forward to
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void *ptr, size_t size);
+
+struct AllocSite {
+	void *stack[ALLOC_SITE_DEPTH];
+	int depth;
+	enum AllocPhase phase;
+	unsigned long count, bytes;
+};
+
+struct AllocTotals {
+	unsigned long count, bytes;
+	unsigned long frames; /*!< Frames which allocated at all. */
+	unsigned long worst; /*!< Most allocations in a single frame. */
+};
+
+static const char *phase_names[ALLOC_PHASE_COUNT] = {
+	"none", "Logic", "Draw", "ProcessEvent"
+};
+
+static struct {
+	bool enabled, strict;
+	bool steady; /*!< Set by the gamestate for the current frame. */
+	int steady_frames; /*!< Consecutive frames spent in steady state. */
+	unsigned long frames;
+	struct { unsigned long count, bytes; } frame[ALLOC_PHASE_COUNT];
+	struct AllocTotals totals[ALLOC_PHASE_COUNT];
+	struct AllocSite sites[ALLOC_SITES];
+	unsigned long lost; /*!< Allocations whose call site didn't fit into the table. */
+} tracker;
+
+// set only by the main thread, so allocations of other threads are never counted
+static __thread enum AllocPhase current_phase;
+static __thread bool recording;
+
+static void FailSteadyState(enum AllocPhase phase, size_t size) {
+	char message[128];
+	void *stack[32];
+	int length = snprintf(message, sizeof(message), "Allocated %zu bytes in steady-state %s:\n", size, phase_names[phase]);
+	ssize_t __attribute__((unused)) n = write(STDERR_FILENO, message, length);
+	int depth = backtrace(stack, 32);
+	backtrace_symbols_fd(stack, depth, STDERR_FILENO);
+	abort();
+}
+
+static struct AllocSite* FindSite(enum AllocPhase phase, void **stack, int depth) {
+	uintptr_t hash = phase;
+	int i, n;
+	for (i=0; i<depth; i++) {
+		hash = (hash ^ (uintptr_t)stack[i]) * 0x9e3779b1u;
+	}
+	for (n=0; n<ALLOC_SITES; n++) {
+		struct AllocSite *site = &tracker.sites[(hash + n) % ALLOC_SITES];
+		if (!site->count) {
+			site->phase = phase;
+			site->depth = depth;
+			memcpy(site->stack, stack, depth * sizeof(void*));
+			return site;
+		}
+		if ((site->phase == phase) && (site->depth == depth) && !memcmp(site->stack, stack, depth * sizeof(void*))) {
+			return site;
+		}
+	}
+	return NULL;
+}
+
+// kept out of line, so the replaced allocator is always exactly one frame up
+static __attribute__((noinline)) void RecordAllocation(size_t size) {
+	enum AllocPhase phase = current_phase;
+	if (!phase || recording || !tracker.enabled) return;
+	recording = true;
+	if (tracker.strict && (tracker.steady_frames >= ALLOC_WARMUP)) {
+		FailSteadyState(phase, size);
+	}
+	tracker.frame[phase].count++;
+	tracker.frame[phase].bytes += size;
+
+	void *stack[ALLOC_SITE_DEPTH + 2];
+	int depth = backtrace(stack, ALLOC_SITE_DEPTH + 2) - 2;
+	struct AllocSite *site = FindSite(phase, stack + 2, depth > 0 ? depth : 0);
+	if (site) {
+		site->count++;
+		site->bytes += size;
+	} else {
+		tracker.lost++;
+	}
+	recording = false;
+}
+
+void* malloc(size_t size) {
+	RecordAllocation(size);
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+	RecordAllocation(count * size);
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void *ptr, size_t size) {
+	RecordAllocation(size);
+	return __libc_realloc(ptr, size);
+}
+
+void StartAllocTracking(void) {
+	char *mode = getenv("RADIOEDIT_ALLOC");
+	tracker.enabled = !mode || strcmp(mode, "0");
+	tracker.strict = mode && !strcmp(mode, "strict");
+	// the first backtrace loads the unwinder, which allocates
+	void *stack[1];
+	backtrace(stack, 1);
+}
+
+/*! \brief Attributes allocations of the calling thread to given phase, until EndAllocPhase. */
+void BeginAllocPhase(enum AllocPhase phase) {
+	current_phase = phase;
+}
+
+static void FinishFrame(void) {
+	int phase;
+	bool allocated = false;
+	for (phase=ALLOC_PHASE_LOGIC; phase<ALLOC_PHASE_COUNT; phase++) {
+		unsigned long count = tracker.frame[phase].count;
+		if (!count) continue;
+		struct AllocTotals *totals = &tracker.totals[phase];
+		totals->count += count;
+		totals->bytes += tracker.frame[phase].bytes;
+		totals->frames++;
+		if (count > totals->worst) totals->worst = count;
+		allocated = true;
+	}
+	if (allocated) {
+		LogEvent(LOG_FRAME_ALLOCS, (int)tracker.frame[ALLOC_PHASE_LOGIC].count, (int)tracker.frame[ALLOC_PHASE_DRAW].count,
+		         (int)tracker.frame[ALLOC_PHASE_EVENT].count);
+	}
+	memset(tracker.frame, 0, sizeof(tracker.frame));
+	tracker.frames++;
+	tracker.steady_frames = tracker.steady ? tracker.steady_frames + 1 : 0;
+}
+
+/*! \brief Ends the current phase; ending a Draw completes the frame. */
+void EndAllocPhase(void) {
+	enum AllocPhase phase = current_phase;
+	current_phase = ALLOC_PHASE_NONE;
+	if (phase == ALLOC_PHASE_DRAW) {
+		FinishFrame();
+	}
+}
+
+/*! \brief Marks whether the game is in a state where frames are expected not to allocate at all. */
+void SetAllocSteadyState(bool steady) {
+	tracker.steady = steady;
+}
+
+static int CompareSites(const void *a, const void *b) {
+	const struct AllocSite *x = *(struct AllocSite * const *)a, *y = *(struct AllocSite * const *)b;
+	return (x->count < y->count) - (x->count > y->count);
+}
+
+void FinishAllocTracking(void) {
+	if (!tracker.enabled) return;
+	tracker.enabled = false;
+	fprintf(stderr, "Allocations over %lu frames:\n", tracker.frames);
+	int phase, i, count = 0;
+	for (phase=ALLOC_PHASE_LOGIC; phase<ALLOC_PHASE_COUNT; phase++) {
+		struct AllocTotals *totals = &tracker.totals[phase];
+		fprintf(stderr, "  %-12s %8lu allocations, %10lu bytes, in %lu frames, at most %lu per frame\n",
+		        phase_names[phase], totals->count, totals->bytes, totals->frames, totals->worst);
+	}
+	if (tracker.lost) {
+		fprintf(stderr, "  %lu allocations from call sites which didn't fit the table\n", tracker.lost);
+	}
+
+	static struct AllocSite *sorted[ALLOC_SITES];
+	for (i=0; i<ALLOC_SITES; i++) {
+		if (tracker.sites[i].count) sorted[count++] = &tracker.sites[i];
+	}
+	qsort(sorted, count, sizeof(struct AllocSite*), CompareSites);
+	for (i=0; (i<count) && (i<ALLOC_REPORTED_SITES); i++) {
+		fprintf(stderr, "%s: %lu allocations, %lu bytes\n", phase_names[sorted[i]->phase], sorted[i]->count, sorted[i]->bytes);
+		fflush(stderr);
+		backtrace_symbols_fd(sorted[i]->stack, sorted[i]->depth, STDERR_FILENO);
+	}
+}
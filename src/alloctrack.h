@@ -0,0 +1,39 @@
+#ifndef RADIOEDIT_ALLOCTRACK_H
+#define RADIOEDIT_ALLOCTRACK_H
+
+#include <stdbool.h>
+
+/* Debug accounting of heap allocations made by the main thread while it runs
+ * gamestate callbacks, enabled with the ALLOC_TRACKER build option (glibc
+ * only, as it replaces malloc). Per-frame counts go to the "memory" log
+ * category and call sites are reported at exit. With RADIOEDIT_ALLOC=strict
+ * the game aborts on the first allocation in steady-state gameplay. */
+
+enum AllocPhase {
+	ALLOC_PHASE_NONE,
+	ALLOC_PHASE_LOGIC,
+	ALLOC_PHASE_DRAW,
+	ALLOC_PHASE_EVENT,
+	ALLOC_PHASE_COUNT
+};
+
+#define ALLOC_SITES 512 /*!< Distinct call sites remembered. */
+#define ALLOC_SITE_DEPTH 4 /*!< Return addresses identifying a call site. */
+#define ALLOC_REPORTED_SITES 20
+#define ALLOC_WARMUP 60 /*!< Frames of steady state before strict mode starts checking. */
+
+#ifdef RADIOEDIT_ALLOC_TRACKER
+void StartAllocTracking(void);
+void BeginAllocPhase(enum AllocPhase phase);
+void EndAllocPhase(void);
+void SetAllocSteadyState(bool steady);
+void FinishAllocTracking(void);
+#else
+#define StartAllocTracking() do {} while (0)
+#define BeginAllocPhase(phase) do {} while (0)
+#define EndAllocPhase() do {} while (0)
+#define SetAllocSteadyState(steady) do {} while (0)
+#define FinishAllocTracking() do {} while (0)
+#endif
+
+#endif
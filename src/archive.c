@@ -0,0 +1,267 @@
+/*! \file archive.c
+ *  \brief Memory-mapped archive with packed game data.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include <libsuperderpy.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define ARCHIVE_FILENAME "radioedit.pak"
+
+/*! \brief State of a file handle reading straight from the mapping. */
+struct ArchiveFile {
+	const unsigned char *data;
+	int64_t size;
+	int64_t pos;
+};
+
+static bool ArchiveFileClose(ALLEGRO_FILE *f) {
+	free(al_get_file_userdata(f));
+	return true;
+}
+
+static size_t ArchiveFileRead(ALLEGRO_FILE *f, void *ptr, size_t size) {
+	struct ArchiveFile *file = al_get_file_userdata(f);
+	if (file->pos >= file->size) return 0;
+	if ((int64_t)size > file->size - file->pos) size = file->size - file->pos;
+	memcpy(ptr, file->data + file->pos, size);
+	file->pos += size;
+	return size;
+}
+
+static size_t ArchiveFileWrite(ALLEGRO_FILE *f, const void *ptr, size_t size) {
+	return 0;
+}
+
+static bool ArchiveFileFlush(ALLEGRO_FILE *f) {
+	return true;
+}
+
+static int64_t ArchiveFileTell(ALLEGRO_FILE *f) {
+	struct ArchiveFile *file = al_get_file_userdata(f);
+	return file->pos;
+}
+
+static bool ArchiveFileSeek(ALLEGRO_FILE *f, int64_t offset, int whence) {
+	struct ArchiveFile *file = al_get_file_userdata(f);
+	int64_t pos = offset;
+	if (whence == ALLEGRO_SEEK_CUR) pos += file->pos;
+	if (whence == ALLEGRO_SEEK_END) pos += file->size;
+	if ((pos < 0) || (pos > file->size)) return false;
+	file->pos = pos;
+	return true;
+}
+
+static bool ArchiveFileEOF(ALLEGRO_FILE *f) {
+	struct ArchiveFile *file = al_get_file_userdata(f);
+	return file->pos >= file->size;
+}
+
+static int ArchiveFileError(ALLEGRO_FILE *f) {
+	return 0;
+}
+
+static const char* ArchiveFileErrorMessage(ALLEGRO_FILE *f) {
+	return "";
+}
+
+static void ArchiveFileClearError(ALLEGRO_FILE *f) {}
+
+static int ArchiveFileUngetc(ALLEGRO_FILE *f, int c) {
+	struct ArchiveFile *file = al_get_file_userdata(f);
+	if (file->pos == 0) return -1;
+	file->pos--; // the mapping is read-only, so only the byte just read can be pushed back
+	return c;
+}
+
+static int64_t ArchiveFileSize(ALLEGRO_FILE *f) {
+	struct ArchiveFile *file = al_get_file_userdata(f);
+	return file->size;
+}
+
+static const ALLEGRO_FILE_INTERFACE archive_file_interface = {
+	NULL,
+	ArchiveFileClose,
+	ArchiveFileRead,
+	ArchiveFileWrite,
+	ArchiveFileFlush,
+	ArchiveFileTell,
+	ArchiveFileSeek,
+	ArchiveFileEOF,
+	ArchiveFileError,
+	ArchiveFileErrorMessage,
+	ArchiveFileClearError,
+	ArchiveFileUngetc,
+	ArchiveFileSize
+};
+
+#define DATA_PROBE_FILE "fonts/DejaVuSansMono.ttf" /*!< libsuperderpy loads its console font from it, so it's always installed loose. */
+
+/*! \brief Data directory libsuperderpy's GetDataFilePath resolves files into, with a trailing slash. */
+char* FindDataDirectory(struct Game *game) {
+	char *probe = GetDataFilePath(game, DATA_PROBE_FILE);
+	ALLEGRO_PATH *path = al_create_path(probe);
+	al_set_path_filename(path, NULL);
+	al_drop_path_tail(path); // fonts/
+	char *dir = strdup(al_path_cstr(path, '/'));
+	al_destroy_path(path);
+	free(probe);
+	return dir;
+}
+
+/*! \brief Looks for a loose file in the data directory libsuperderpy uses. */
+bool FindDataFile(struct Game *game, char* path, char* result, size_t length) {
+	if (!game->data) return false;
+	snprintf(result, length, "%s%s", game->data->datadir, path);
+	return al_filename_exists(result);
+}
+
+/*! \brief Reads a little endian integer of the archive, regardless of the host byte order. */
+static uint32_t ReadU32(const uint32_t *src) {
+	const unsigned char *bytes = (const unsigned char*)src;
+	return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static int CompareEntries(const void *key, const void *entry) {
+	return strncmp(key, ((const struct ArchiveEntry*)entry)->name, ARCHIVE_NAME_LENGTH);
+}
+
+struct DataArchive* OpenDataArchive(struct Game *game, char* datadir) {
+	char filename[1024];
+	snprintf(filename, sizeof(filename), "%s%s", datadir, ARCHIVE_FILENAME);
+	if (!al_filename_exists(filename)) {
+		PrintConsole(game, "No data archive found, using loose files.");
+		return NULL;
+	}
+
+	struct DataArchive *archive = calloc(1, sizeof(struct DataArchive));
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		free(archive);
+		return NULL;
+	}
+	archive->size = GetFileSize(file, NULL);
+	HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping) {
+		free(archive);
+		return NULL;
+	}
+	archive->map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	archive->handle = mapping;
+	if (!archive->map) {
+		CloseHandle(mapping);
+		free(archive);
+		return NULL;
+	}
+#else
+	int fd = open(filename, O_RDONLY);
+	struct stat st;
+	if ((fd < 0) || (fstat(fd, &st) < 0)) {
+		if (fd >= 0) close(fd);
+		free(archive);
+		return NULL;
+	}
+	archive->size = st.st_size;
+	void *map = mmap(NULL, archive->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		free(archive);
+		return NULL;
+	}
+	archive->map = map;
+#endif
+
+	const struct ArchiveHeader *header = (const struct ArchiveHeader*)archive->map;
+	if ((archive->size < sizeof(struct ArchiveHeader)) || memcmp(header->magic, ARCHIVE_MAGIC, 4) || (ReadU32(&header->version) != ARCHIVE_VERSION)
+	    || (archive->size < sizeof(struct ArchiveHeader) + (size_t)ReadU32(&header->count) * sizeof(struct ArchiveEntry))) {
+		PrintConsole(game, "Data archive %s is invalid, ignoring.", filename);
+		CloseDataArchive(archive);
+		return NULL;
+	}
+	archive->count = ReadU32(&header->count);
+	archive->entries = (const struct ArchiveEntry*)(archive->map + sizeof(struct ArchiveHeader));
+
+	PrintConsole(game, "Mapped data archive %s (%u files, %zu KiB).", filename, archive->count, archive->size / 1024);
+	return archive;
+}
+
+void CloseDataArchive(struct DataArchive *archive) {
+	if (!archive) return;
+#ifdef _WIN32
+	UnmapViewOfFile(archive->map);
+	CloseHandle(archive->handle);
+#else
+	munmap((void*)archive->map, archive->size);
+#endif
+	free(archive);
+}
+
+static const struct ArchiveEntry* FindArchiveEntry(struct Game *game, char* path) {
+	struct DataArchive *archive = game->data ? game->data->archive : NULL;
+	if (!archive) return NULL;
+	const struct ArchiveEntry *entry = bsearch(path, archive->entries, archive->count, sizeof(struct ArchiveEntry), CompareEntries);
+	if (entry && ((size_t)ReadU32(&entry->offset) + ReadU32(&entry->size) <= archive->size)) {
+		return entry;
+	}
+	return NULL;
+}
+
+/*! \brief Checks whether a data file is available, either in the archive or loose. */
+bool DataFileExists(struct Game *game, char* path) {
+	char filename[1024];
+	return FindArchiveEntry(game, path) || FindDataFile(game, path, filename, sizeof(filename));
+}
+
+/*! \brief Opens a data file from the archive, falling back to loose files for ones it doesn't have.
+ *
+ * Looking for a loose file takes a few stat calls, so it's only done first in
+ * debug mode, where edited files override the archive and get hot-reloaded.
+ */
+ALLEGRO_FILE* OpenDataFile(struct Game *game, char* path) {
+	char filename[1024];
+	bool loose_first = game->config.debug;
+	if (loose_first && FindDataFile(game, path, filename, sizeof(filename))) {
+		return al_fopen(filename, "rb");
+	}
+
+	const struct ArchiveEntry *entry = FindArchiveEntry(game, path);
+	if (entry) {
+		struct ArchiveFile *file = malloc(sizeof(struct ArchiveFile));
+		file->data = game->data->archive->map + ReadU32(&entry->offset);
+		file->size = ReadU32(&entry->size);
+		file->pos = 0;
+		return al_create_file_handle(&archive_file_interface, file);
+	}
+	if (!loose_first && FindDataFile(game, path, filename, sizeof(filename))) {
+		return al_fopen(filename, "rb");
+	}
+
+	PrintConsole(game, "Can't find data file %s!", path);
+	return NULL;
+}
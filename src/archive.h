@@ -0,0 +1,50 @@
+#ifndef RADIOEDIT_ARCHIVE_H
+#define RADIOEDIT_ARCHIVE_H
+
+#include <stdint.h>
+
+#define ARCHIVE_MAGIC "RPAK"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_NAME_LENGTH 56
+#define ARCHIVE_ALIGNMENT 16
+
+/*! \brief On-disk archive header. All integers are little endian. */
+struct ArchiveHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t count; /*!< Number of entries in the index following the header. */
+	uint32_t reserved;
+};
+
+/*! \brief On-disk index entry; the index is sorted by name. */
+struct ArchiveEntry {
+	char name[ARCHIVE_NAME_LENGTH]; /*!< Path relative to data directory, NUL terminated. */
+	uint32_t offset; /*!< Offset of file contents from the beginning of the archive. */
+	uint32_t size;
+};
+
+#ifndef RADIOEDIT_PACK_TOOL
+
+#include <allegro5/allegro.h>
+
+struct Game;
+
+/*! \brief Memory-mapped data archive. */
+struct DataArchive {
+	const unsigned char *map;
+	size_t size;
+	uint32_t count;
+	const struct ArchiveEntry *entries;
+	void *handle; /*!< Platform specific mapping handle. */
+};
+
+char* FindDataDirectory(struct Game *game);
+struct DataArchive* OpenDataArchive(struct Game *game, char* datadir);
+void CloseDataArchive(struct DataArchive *archive);
+bool FindDataFile(struct Game *game, char* path, char* result, size_t length);
+bool DataFileExists(struct Game *game, char* path);
+ALLEGRO_FILE* OpenDataFile(struct Game *game, char* path);
+
+#endif
+
+#endif
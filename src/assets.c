@@ -0,0 +1,751 @@
+/*! \file assets.c
+ *  \brief Asset loading helpers with memory accounting.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include <libsuperderpy.h>
+
+static const char* kind_names[ASSET_KIND_COUNT] = {
+	"bitmap", "sample", "instance", "font", "spritesheet"
+};
+
+static size_t BitmapSize(ALLEGRO_BITMAP *bitmap) {
+	if (!bitmap) return 0;
+	return (size_t)al_get_bitmap_width(bitmap) * al_get_bitmap_height(bitmap) * al_get_pixel_size(al_get_bitmap_format(bitmap));
+}
+
+static void MeasureBitmap(struct AssetRecord *record, ALLEGRO_BITMAP *bitmap) {
+	record->ram = 0;
+	record->vram = 0;
+	if (!bitmap) return;
+	if (al_get_bitmap_flags(bitmap) & ALLEGRO_MEMORY_BITMAP) {
+		record->ram = BitmapSize(bitmap);
+	} else {
+		record->vram = BitmapSize(bitmap);
+	}
+}
+
+static void MeasureAsset(struct AssetRecord *record) {
+	ALLEGRO_SAMPLE *sample;
+	switch (record->kind) {
+		case ASSET_BITMAP:
+			MeasureBitmap(record, record->asset);
+			break;
+		case ASSET_SPRITESHEET:
+			MeasureBitmap(record, ((struct Spritesheet*)record->asset)->bitmap);
+			break;
+		case ASSET_SAMPLE:
+			sample = record->asset;
+			record->ram = (size_t)al_get_sample_length(sample) * al_get_channel_count(al_get_sample_channels(sample))
+			              * al_get_audio_depth_size(al_get_sample_depth(sample));
+			break;
+		case ASSET_FONT:
+			// fonts don't expose their glyph bitmaps; vram is set to the atlas size at load time
+			break;
+		default:
+			// sample instances play straight from the sample buffer, which is accounted already
+			break;
+	}
+}
+
+static struct AssetRecord* TrackAsset(struct Game *game, enum AssetKind kind, char* owner, char* name, char* path, void *asset) {
+	if (!game->data || !asset) return NULL;
+	struct AssetRecord *record = calloc(1, sizeof(struct AssetRecord));
+	record->kind = kind;
+	strncpy(record->owner, owner, sizeof(record->owner)-1);
+	strncpy(record->name, name, sizeof(record->name)-1);
+	if (path) strncpy(record->path, path, sizeof(record->path)-1);
+	record->asset = asset;
+	record->watch = path ? WatchDataFile(game, path) : -1;
+	MeasureAsset(record);
+	record->next = game->data->assets;
+	game->data->assets = record;
+	return record;
+}
+
+static void DestroyAsset(enum AssetKind kind, void *asset) {
+	switch (kind) {
+		case ASSET_BITMAP:
+			al_destroy_bitmap(asset);
+			break;
+		case ASSET_SAMPLE:
+			al_destroy_sample(asset);
+			break;
+		case ASSET_FONT:
+			al_destroy_font(asset);
+			break;
+		default:
+			break;
+	}
+}
+
+/*! \brief Destroys least recently used unreferenced assets until the cache fits its limit. */
+static void EvictAssets(struct AssetCache *cache) {
+	while (true) {
+		size_t total = 0;
+		struct CachedAsset **lru = NULL, **link = &cache->entries;
+		while (*link) {
+			total += (*link)->ram + (*link)->vram;
+			if (!(*link)->refs && (!lru || ((*link)->used < (*lru)->used))) {
+				lru = link;
+			}
+			link = &(*link)->next;
+		}
+		if ((total <= cache->limit) || !lru) return;
+		struct CachedAsset *entry = *lru;
+		*lru = entry->next;
+		DestroyAsset(entry->kind, entry->asset);
+		free(entry);
+	}
+}
+
+/*! \brief Takes a reference to an already decoded asset, NULL when it's not in the cache. */
+static struct CachedAsset* AcquireCachedAsset(struct Game *game, enum AssetKind kind, char* path, int size) {
+	if (!game->data) return NULL;
+	struct AssetCache *cache = &game->data->cache;
+	struct CachedAsset *entry = cache->entries;
+	while (entry) {
+		if ((entry->kind == kind) && (entry->size == size) && !strcmp(entry->path, path)) {
+			entry->refs++;
+			entry->used = ++cache->clock;
+			cache->hits++;
+			return entry;
+		}
+		entry = entry->next;
+	}
+	cache->misses++;
+	return NULL;
+}
+
+/*! \brief Puts a freshly decoded asset into the cache, referenced by its record. */
+static void CacheAsset(struct Game *game, struct AssetRecord *record) {
+	if (!record) return;
+	struct AssetCache *cache = &game->data->cache;
+	struct CachedAsset *entry = calloc(1, sizeof(struct CachedAsset));
+	entry->kind = record->kind;
+	strncpy(entry->path, record->path, sizeof(entry->path)-1);
+	entry->size = record->size;
+	entry->asset = record->asset;
+	entry->ram = record->ram;
+	entry->vram = record->vram;
+	entry->refs = 1;
+	entry->used = ++cache->clock;
+	entry->next = cache->entries;
+	cache->entries = entry;
+	record->cached = entry;
+	EvictAssets(cache);
+}
+
+static void TrackCachedAsset(struct Game *game, char* owner, char* name, struct CachedAsset *entry) {
+	struct AssetRecord *record = TrackAsset(game, entry->kind, owner, name, entry->path, entry->asset);
+	if (!record) return;
+	record->size = entry->size;
+	record->ram = entry->ram;
+	record->vram = entry->vram;
+	record->cached = entry;
+}
+
+void InitAssetCache(struct Game *game, struct AssetCache *cache) {
+	// the limit is set in KiB, e.g. "[cache] limit=16384"
+	cache->limit = (size_t)atoi(GetConfigOptionDefault(game, "cache", "limit", "32768")) * 1024;
+	cache->entries = NULL;
+	cache->clock = 0;
+	cache->hits = 0;
+	cache->misses = 0;
+}
+
+void DestroyAssetCache(struct AssetCache *cache) {
+	while (cache->entries) {
+		struct CachedAsset *next = cache->entries->next;
+		DestroyAsset(cache->entries->kind, cache->entries->asset);
+		free(cache->entries);
+		cache->entries = next;
+	}
+}
+
+static char* FileExtension(char* path) {
+	char *ext = strrchr(path, '.');
+	return ext ? ext : "";
+}
+
+static ALLEGRO_BITMAP* DecodeBitmap(struct Game *game, char* path) {
+	ALLEGRO_BITMAP *indexed = DecodeIndexedBitmap(game, path);
+	if (indexed) return indexed;
+	ALLEGRO_FILE *file = OpenDataFile(game, path);
+	if (!file) return NULL;
+	TraceBegin(path);
+	ALLEGRO_BITMAP *bitmap = al_load_bitmap_f(file, FileExtension(path));
+	TraceEnd(path);
+	al_fclose(file);
+	return bitmap;
+}
+
+static ALLEGRO_SAMPLE* DecodeSample(struct Game *game, char* path) {
+	ALLEGRO_FILE *file = OpenDataFile(game, path);
+	if (!file) return NULL;
+	TraceBegin(path);
+	ALLEGRO_SAMPLE *sample = al_load_sample_f(file, FileExtension(path));
+	TraceEnd(path);
+	al_fclose(file);
+	return sample;
+}
+
+/*! \brief Loads a bitmap font baked from the TTF file at given size.
+ *
+ * Uses the atlas pre-baked at build time when there is one, otherwise the TTF
+ * is rasterized into an atlas right away, so drawing never hits the TTF renderer.
+ */
+static ALLEGRO_FONT* DecodeFont(struct Game *game, char* path, int size, size_t *vram) {
+	char baked[255];
+	ALLEGRO_BITMAP *atlas = NULL;
+	GetBakedFontName(path, size, baked, sizeof(baked));
+	if (DataFileExists(game, baked)) {
+		atlas = DecodeBitmap(game, baked);
+	}
+	if (!atlas) {
+		ALLEGRO_FILE *file = OpenDataFile(game, path);
+		if (!file) return NULL;
+		TraceBegin(path);
+		// the font takes ownership of the file
+		ALLEGRO_FONT *ttf = al_load_ttf_font_f(file, path, size, 0);
+		if (ttf) {
+			atlas = BakeFontAtlas(ttf);
+			al_destroy_font(ttf);
+		}
+		TraceEnd(path);
+		if (!atlas) return NULL;
+	}
+	ALLEGRO_FONT *font = GrabBakedFont(atlas);
+	*vram = BitmapSize(atlas);
+	al_destroy_bitmap(atlas);
+	return font;
+}
+
+static bool DecodeSpritesheetConfig(struct Game *game, char* character, struct Spritesheet *s) {
+	char filename[255];
+	snprintf(filename, 255, "sprites/%s/%s.ini", character, s->name);
+	TraceBegin(filename);
+	ALLEGRO_FILE *file = OpenDataFile(game, filename);
+	ALLEGRO_CONFIG *config = file ? al_load_config_file_f(file) : NULL;
+	if (file) al_fclose(file);
+	TraceEnd(filename);
+	if (!config) return false;
+	s->cols = atoi(al_get_config_value(config, "", "cols"));
+	s->rows = atoi(al_get_config_value(config, "", "rows"));
+	s->blanks = atoi(al_get_config_value(config, "", "blanks"));
+	s->delay = atof(al_get_config_value(config, "", "delay"));
+	const char *kill = al_get_config_value(config, "", "kill");
+	s->kill = kill ? atoi(kill) : false;
+	const char *successor = al_get_config_value(config, "", "successor");
+	free(s->successor);
+	s->successor = NULL;
+	if (successor) {
+		s->successor = malloc(255*sizeof(char));
+		strncpy(s->successor, successor, 255);
+	}
+	al_destroy_config(config);
+	return true;
+}
+
+static int CompareSpriteManifest(const void *key, const void *entry) {
+	const struct SpriteManifestEntry *a = key, *b = entry;
+	int result = strcmp(a->character, b->character);
+	return result ? result : strcmp(a->name, b->name);
+}
+
+static const struct SpriteManifestEntry* FindSpriteManifest(char* character, char* name) {
+	struct SpriteManifestEntry key = { .character = character, .name = name };
+	return bsearch(&key, sprite_manifest, sprite_manifest_count, sizeof(struct SpriteManifestEntry), CompareSpriteManifest);
+}
+
+static void ApplySpriteManifest(const struct SpriteManifestEntry *entry, struct Spritesheet *s) {
+	s->rows = entry->rows;
+	s->cols = entry->cols;
+	s->blanks = entry->blanks;
+	s->delay = entry->delay;
+	s->kill = entry->kill;
+	free(s->successor);
+	s->successor = NULL;
+	if (entry->successor) {
+		s->successor = malloc(255*sizeof(char));
+		strncpy(s->successor, entry->successor, 255);
+	}
+	s->width = entry->width;
+	s->height = entry->height;
+}
+
+static void UpdateSpritesheetSize(struct Spritesheet *s) {
+	if (!s->bitmap) return;
+	s->width = al_get_bitmap_width(s->bitmap) / s->cols;
+	s->height = al_get_bitmap_height(s->bitmap) / s->rows;
+}
+
+/*! \brief Loads a bitmap or takes it from the cache; it must not be destroyed by the gamestate. */
+ALLEGRO_BITMAP* LoadBitmapAsset(struct Game *game, char* owner, char* path) {
+	struct CachedAsset *entry = AcquireCachedAsset(game, ASSET_BITMAP, path, 0);
+	if (entry) {
+		TrackCachedAsset(game, owner, path, entry);
+		return entry->asset;
+	}
+	ALLEGRO_BITMAP *bitmap = DecodeBitmap(game, path);
+	CacheAsset(game, TrackAsset(game, ASSET_BITMAP, owner, path, path, bitmap));
+	return bitmap;
+}
+
+ALLEGRO_BITMAP* CreateBitmapAsset(struct Game *game, char* owner, char* name, int width, int height) {
+	ALLEGRO_BITMAP *bitmap = al_create_bitmap(width, height);
+	TrackAsset(game, ASSET_BITMAP, owner, name, NULL, bitmap);
+	return bitmap;
+}
+
+/*! \brief Loads a sample or takes it from the cache; it must not be destroyed by the gamestate. */
+ALLEGRO_SAMPLE* LoadSampleAsset(struct Game *game, char* owner, char* path) {
+	struct CachedAsset *entry = AcquireCachedAsset(game, ASSET_SAMPLE, path, 0);
+	if (entry) {
+		TrackCachedAsset(game, owner, path, entry);
+		return entry->asset;
+	}
+	ALLEGRO_SAMPLE *sample = DecodeSample(game, path);
+	CacheAsset(game, TrackAsset(game, ASSET_SAMPLE, owner, path, path, sample));
+	return sample;
+}
+
+ALLEGRO_SAMPLE_INSTANCE* CreateSampleInstanceAsset(struct Game *game, char* owner, char* name, ALLEGRO_SAMPLE *sample) {
+	ALLEGRO_SAMPLE_INSTANCE *instance = al_create_sample_instance(sample);
+	struct AssetRecord *record = TrackAsset(game, ASSET_SAMPLE_INSTANCE, owner, name, NULL, instance);
+	if (record) record->parent = sample;
+	return instance;
+}
+
+/*! \brief Loads a font or takes it from the cache; it must not be destroyed by the gamestate. */
+ALLEGRO_FONT* LoadFontAsset(struct Game *game, char* owner, char* path, int size) {
+	char name[255];
+	snprintf(name, 255, "%s@%d", path, size);
+	struct CachedAsset *entry = AcquireCachedAsset(game, ASSET_FONT, path, size);
+	if (entry) {
+		TrackCachedAsset(game, owner, name, entry);
+		return entry->asset;
+	}
+	size_t vram = 0;
+	ALLEGRO_FONT *font = DecodeFont(game, path, size, &vram);
+	struct AssetRecord *record = TrackAsset(game, ASSET_FONT, owner, name, path, font);
+	if (record) {
+		record->size = size;
+		record->vram = vram;
+		CacheAsset(game, record);
+	}
+	return font;
+}
+
+/*! \brief Draws text the way DrawTextWithShadow does, with a fixed drop shadow regardless of the colour.
+ *
+ * Both passes use the same atlas, so with drawing held they end up in one draw call.
+ * The shadow is left out when the governor drops QUALITY_TEXT_SHADOW.
+ */
+void DrawShadowedText(struct Game *game, ALLEGRO_FONT *font, ALLEGRO_COLOR color, float x, float y, int flags, char const* text) {
+	if (!HasQuality(game, QUALITY_TEXT_SHADOW)) {
+		al_draw_text(font, color, (int)x, (int)y, flags, text);
+		return;
+	}
+	bool held = al_is_bitmap_drawing_held();
+	al_hold_bitmap_drawing(true);
+	al_draw_text(font, al_map_rgba(0, 0, 0, 128), (int)x + 1, (int)y + 1, flags, text);
+	al_draw_text(font, color, (int)x, (int)y, flags, text);
+	al_hold_bitmap_drawing(held);
+}
+
+/*! \brief Same as libsuperderpy's CreateCharacter, for characters drawn with DrawCharacterFrame. */
+struct Character* CreateCharacterAsset(struct Game *game, char* name) {
+	struct Character *character = CreateCharacter(game, name);
+	character->data = calloc(1, sizeof(struct CharacterFrames));
+	return character;
+}
+
+void DestroyCharacterAsset(struct Game *game, struct Character *character) {
+	free(character->data);
+	DestroyCharacter(game, character);
+}
+
+/*! \brief Same as libsuperderpy's RegisterSpritesheet, but takes the config from the compiled sprite manifest.
+ *
+ * The .ini file is parsed only for spritesheets added after the game was built.
+ */
+void RegisterSpritesheetAsset(struct Game *game, struct Character *character, char* name) {
+	struct Spritesheet *s = character->spritesheets;
+	while (s) {
+		if (!strcmp(s->name, name)) {
+			return;
+		}
+		s = s->next;
+	}
+	s = calloc(1, sizeof(struct Spritesheet));
+	s->name = strdup(name);
+	const struct SpriteManifestEntry *entry = FindSpriteManifest(character->name, name);
+	if (entry) {
+		ApplySpriteManifest(entry, s);
+	} else if (!DecodeSpritesheetConfig(game, character->name, s)) {
+		PrintConsole(game, "Can't register spritesheet %s for character %s!", name, character->name);
+		free(s->name);
+		free(s);
+		return;
+	}
+	s->next = character->spritesheets;
+	character->spritesheets = s;
+}
+
+/*! \brief Same as libsuperderpy's LoadSpritesheets, but reads through OpenDataFile and tracks the bitmaps. */
+void LoadSpritesheetAssets(struct Game *game, char* owner, struct Character *character) {
+	struct Spritesheet *tmp = character->spritesheets;
+	while (tmp) {
+		char filename[255];
+		snprintf(filename, 255, "sprites/%s/%s.png", character->name, tmp->name);
+		if (!tmp->bitmap) {
+			tmp->bitmap = DecodeBitmap(game, filename);
+			UpdateSpritesheetSize(tmp);
+		}
+		TrackAsset(game, ASSET_SPRITESHEET, owner, filename, filename, tmp);
+		tmp = tmp->next;
+	}
+}
+
+/*! \brief Same as libsuperderpy's DrawCharacter, but draws straight from the spritesheet using manifest frame rectangles.
+ *
+ * The character has to come from CreateCharacterAsset; the manifest is only
+ * searched when it switched spritesheets since the last draw.
+ */
+void DrawCharacterFrame(struct Game *game, struct Character *character, ALLEGRO_COLOR tint, int flags) {
+	if (character->dead) return;
+	struct Spritesheet *s = character->spritesheet;
+	struct CharacterFrames *frames = character->data;
+	if (frames->spritesheet != s) {
+		frames->spritesheet = s;
+		frames->manifest = FindSpriteManifest(character->name, s->name);
+	}
+	const struct SpriteManifestEntry *entry = frames->manifest;
+	struct SpriteFrame frame;
+	// the manifest is stale when the spritesheet was hot-reloaded with different layout
+	if (entry && (character->pos < entry->frames_count) && (entry->cols == s->cols) && (entry->rows == s->rows)
+	    && (entry->width == s->width) && (entry->height == s->height)) {
+		frame = entry->frames[character->pos];
+	} else {
+		frame.x = s->width * (character->pos % s->cols);
+		frame.y = s->height * (character->pos / s->cols);
+		frame.w = s->width;
+		frame.h = s->height;
+	}
+	if (IsCompositing(game)) {
+		// characters here never rotate, so the angle can be left out
+		CompositeBitmapRegion(game, s->bitmap, tint, frame.x, frame.y, frame.w, frame.h, character->x, character->y, frame.w, frame.h, flags);
+		return;
+	}
+	UsePaletteShader(game, s->bitmap);
+	al_draw_tinted_scaled_rotated_bitmap_region(s->bitmap, frame.x, frame.y, frame.w, frame.h, tint, frame.w/2, frame.h/2,
+	                                            character->x + frame.w/2, character->y + frame.h/2, 1, 1, character->angle, flags);
+}
+
+static void* DecodeSampleThread(ALLEGRO_THREAD *thread, void *arg) {
+	struct SampleReload *reload = arg;
+	reload->sample = al_load_sample_f(reload->file, reload->extension);
+	al_fclose(reload->file);
+	__atomic_store_n(&reload->done, true, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/*! \brief Starts decoding the record's file again in the background; false when it can't be opened. */
+static bool StartSampleReload(struct Game *game, struct AssetRecord *record) {
+	ALLEGRO_FILE *file = OpenDataFile(game, record->path);
+	if (!file) return false;
+	struct SampleReload *reload = calloc(1, sizeof(struct SampleReload));
+	reload->file = file;
+	strncpy(reload->extension, FileExtension(record->path), sizeof(reload->extension)-1);
+	reload->start = al_get_time();
+	reload->thread = al_create_thread(DecodeSampleThread, reload);
+	al_start_thread(reload->thread);
+	record->reload = reload;
+	return true;
+}
+
+/*! \brief Waits for the decoder and hands over its sample, if any. */
+static ALLEGRO_SAMPLE* JoinSampleReload(struct AssetRecord *record) {
+	struct SampleReload *reload = record->reload;
+	al_join_thread(reload->thread, NULL);
+	al_destroy_thread(reload->thread);
+	ALLEGRO_SAMPLE *sample = reload->sample;
+	free(reload);
+	record->reload = NULL;
+	return sample;
+}
+
+static void CancelSampleReload(struct AssetRecord *record) {
+	if (!record->reload) return;
+	ALLEGRO_SAMPLE *sample = JoinSampleReload(record);
+	if (sample) al_destroy_sample(sample);
+}
+
+/*! \brief Forgets assets of given gamestate, releasing its references to cached ones.
+ *
+ * Call it after destroying sample instances, as their samples may get evicted here.
+ */
+void UntrackAssets(struct Game *game, char* owner) {
+	if (!game->data) return;
+	ForgetCompositorImages(game);
+	struct AssetRecord **link = &game->data->assets;
+	while (*link) {
+		struct AssetRecord *record = *link;
+		if (!owner || !strcmp(record->owner, owner)) {
+			CancelSampleReload(record);
+			if (record->cached) {
+				record->cached->refs--;
+			}
+			*link = record->next;
+			free(record);
+		} else {
+			link = &record->next;
+		}
+	}
+	EvictAssets(&game->data->cache);
+}
+
+void DestroyAssetRecords(struct AssetRecord *records) {
+	while (records) {
+		struct AssetRecord *next = records->next;
+		CancelSampleReload(records);
+		free(records);
+		records = next;
+	}
+}
+
+size_t GetAssetUsage(struct Game *game, char* owner, size_t *ram, size_t *vram) {
+	size_t r = 0, v = 0;
+	if (game->data) {
+		struct AssetRecord *record = game->data->assets;
+		while (record) {
+			if (!owner || !strcmp(record->owner, owner)) {
+				r += record->ram;
+				v += record->vram;
+			}
+			record = record->next;
+		}
+	}
+	if (ram) *ram = r;
+	if (vram) *vram = v;
+	return r + v;
+}
+
+void DumpAssets(struct Game *game, char* owner) {
+	if (!game->data) return;
+	size_t ram[ASSET_KIND_COUNT] = {0}, vram[ASSET_KIND_COUNT] = {0};
+	int count[ASSET_KIND_COUNT] = {0};
+	struct AssetRecord *record = game->data->assets;
+	while (record) {
+		if (!owner || !strcmp(record->owner, owner)) {
+			PrintConsole(game, "  %-8s %-11s %7zu KiB RAM %7zu KiB VRAM  %s", record->owner, kind_names[record->kind],
+			             record->ram / 1024, record->vram / 1024, record->name);
+			ram[record->kind] += record->ram;
+			vram[record->kind] += record->vram;
+			count[record->kind]++;
+		}
+		record = record->next;
+	}
+	int i;
+	for (i=0; i<ASSET_KIND_COUNT; i++) {
+		if (!count[i]) continue;
+		PrintConsole(game, "%d %s(s): %zu KiB RAM, %zu KiB VRAM", count[i], kind_names[i], ram[i] / 1024, vram[i] / 1024);
+	}
+	size_t r, v;
+	GetAssetUsage(game, owner, &r, &v);
+	PrintConsole(game, "Assets of %s: %zu KiB RAM, %zu KiB VRAM", owner ? owner : "all gamestates", r / 1024, v / 1024);
+
+	struct AssetCache *cache = &game->data->cache;
+	struct CachedAsset *entry = cache->entries;
+	size_t total = 0;
+	int entries = 0, unused = 0;
+	while (entry) {
+		total += entry->ram + entry->vram;
+		entries++;
+		if (!entry->refs) unused++;
+		entry = entry->next;
+	}
+	PrintConsole(game, "Asset cache: %d assets (%d unused), %zu of %zu KiB, %d hits, %d misses", entries, unused,
+	             total / 1024, cache->limit / 1024, cache->hits, cache->misses);
+}
+
+bool CheckAssetBudget(struct Game *game, char* owner) {
+	// budgets are set per gamestate in KiB, e.g. "[budget] menu=4096"
+	int budget = atoi(GetConfigOptionDefault(game, "budget", owner, "0"));
+	if (budget <= 0) return true;
+	size_t usage = GetAssetUsage(game, owner, NULL, NULL);
+	if (usage > (size_t)budget * 1024) {
+		PrintConsole(game, "WARNING: %s uses %zu KiB of assets, over its budget of %d KiB!", owner, usage / 1024, budget);
+		DumpAssets(game, owner);
+		return false;
+	}
+	return true;
+}
+
+static bool SwapSlot(void **slots[], int count, void *old, void *new) {
+	int i;
+	bool found = false;
+	for (i=0; i<count; i++) {
+		if (*slots[i] == old) {
+			*slots[i] = new;
+			found = true;
+		}
+	}
+	return found;
+}
+
+static bool ReloadSpritesheet(struct Game *game, char* path, struct Spritesheet *s) {
+	char character[255];
+	// path is always sprites/<character>/<spritesheet>.png; the .ini is reloaded along with it
+	if (sscanf(path, "sprites/%254[^/]/", character) != 1) return false;
+	ALLEGRO_BITMAP *bitmap = DecodeBitmap(game, path);
+	if (!bitmap) return false;
+	if (!DecodeSpritesheetConfig(game, character, s)) {
+		al_destroy_bitmap(bitmap);
+		return false;
+	}
+	al_destroy_bitmap(s->bitmap);
+	s->bitmap = bitmap;
+	UpdateSpritesheetSize(s);
+	return true;
+}
+
+static void RebindSampleInstances(struct Game *game, ALLEGRO_SAMPLE *old, ALLEGRO_SAMPLE *new) {
+	struct AssetRecord *record = game->data->assets;
+	while (record) {
+		if ((record->kind == ASSET_SAMPLE_INSTANCE) && (record->parent == old)) {
+			ALLEGRO_SAMPLE_INSTANCE *instance = record->asset;
+			bool playing = al_get_sample_instance_playing(instance);
+			unsigned int position = al_get_sample_instance_position(instance);
+			al_set_sample(instance, new);
+			record->parent = new;
+			if (playing && (position < al_get_sample_length(new))) {
+				al_set_sample_instance_position(instance, position);
+				al_play_sample_instance(instance);
+			}
+		}
+		record = record->next;
+	}
+}
+
+/*! \brief Puts the decoded asset in place of the record's old one, which has been destroyed already. */
+static void FinishReload(struct Game *game, struct AssetRecord *record, void *asset, double start) {
+	if (!asset) {
+		PrintConsole(game, "Failed to reload %s!", record->name);
+		return;
+	}
+	record->asset = asset;
+	MeasureAsset(record);
+	ForgetCompositorImages(game);
+	if (record->cached) {
+		record->cached->asset = asset;
+		record->cached->ram = record->ram;
+		record->cached->vram = record->vram;
+	}
+	PrintConsole(game, "Reloaded %s in %.2f ms.", record->name, (al_get_time() - start) * 1000);
+}
+
+/*! \brief Swaps in a sample decoded in the background, rebinding the instances playing it. */
+static void FinishSampleReload(struct Game *game, struct AssetRecord *record, void **slots[], int count) {
+	double start = record->reload->start;
+	ALLEGRO_SAMPLE *sample = JoinSampleReload(record);
+	if (sample && !SwapSlot(slots, count, record->asset, sample)) {
+		al_destroy_sample(sample);
+		sample = NULL;
+	}
+	if (sample) {
+		RebindSampleInstances(game, record->asset, sample);
+		al_destroy_sample(record->asset);
+	}
+	FinishReload(game, record, sample, start);
+}
+
+/*! \brief Decodes again every changed asset of given gamestate and swaps it into one of the slots.
+ *
+ * Slots are the addresses of resource fields holding loaded assets. Spritesheets
+ * and sample instances are updated in place and don't need a slot. Samples
+ * take long to decode, so they're decoded on a thread of their own and
+ * swapped in by a later call, once PollAssetChanges reports them ready.
+ */
+void ReloadAssets(struct Game *game, char* owner, void **slots[], int count) {
+	if (!game->data) return;
+	struct AssetRecord *record = game->data->assets;
+	while (record) {
+		if (strcmp(record->owner, owner)) {
+			record = record->next;
+			continue;
+		}
+		if (record->reload && __atomic_load_n(&record->reload->done, __ATOMIC_ACQUIRE)) {
+			FinishSampleReload(game, record, slots, count);
+		}
+		// a file changed again while it's being decoded is picked up after the decoder finishes
+		if (!record->dirty || record->reload) {
+			record = record->next;
+			continue;
+		}
+		record->dirty = false;
+		if (record->cached && (record->cached->refs > 1)) {
+			// other gamestates hold the asset too and their slots can't be updated from here
+			PrintConsole(game, "Can't reload %s, it's shared with other gamestates.", record->name);
+			record = record->next;
+			continue;
+		}
+		double start = al_get_time();
+		void *asset = NULL;
+		size_t vram = 0;
+		switch (record->kind) {
+			case ASSET_BITMAP:
+				asset = DecodeBitmap(game, record->path);
+				if (asset && !SwapSlot(slots, count, record->asset, asset)) {
+					al_destroy_bitmap(asset);
+					asset = NULL;
+				}
+				if (asset) al_destroy_bitmap(record->asset);
+				break;
+			case ASSET_SAMPLE:
+				if (StartSampleReload(game, record)) {
+					record = record->next;
+					continue;
+				}
+				break;
+			case ASSET_FONT:
+				asset = DecodeFont(game, record->path, record->size, &vram);
+				if (asset && !SwapSlot(slots, count, record->asset, asset)) {
+					al_destroy_font(asset);
+					asset = NULL;
+				}
+				if (asset) {
+					al_destroy_font(record->asset);
+					record->vram = vram;
+				}
+				break;
+			case ASSET_SPRITESHEET:
+				if (ReloadSpritesheet(game, record->path, record->asset)) {
+					asset = record->asset;
+				}
+				break;
+			default:
+				break;
+		}
+		FinishReload(game, record, asset, start);
+		record = record->next;
+	}
+}
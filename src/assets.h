@@ -0,0 +1,99 @@
+#ifndef RADIOEDIT_ASSETS_H
+#define RADIOEDIT_ASSETS_H
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_audio.h>
+#include <allegro5/allegro_font.h>
+#include <allegro5/allegro_ttf.h>
+
+struct Game;
+struct Character;
+
+/*! \brief Kinds of assets known to the memory tracker. */
+enum AssetKind {
+	ASSET_BITMAP,
+	ASSET_SAMPLE,
+	ASSET_SAMPLE_INSTANCE,
+	ASSET_FONT,
+	ASSET_SPRITESHEET,
+	ASSET_KIND_COUNT
+};
+
+/*! \brief Sample being decoded again on its own thread, so a changed file doesn't stall the game. */
+struct SampleReload {
+	ALLEGRO_THREAD *thread;
+	ALLEGRO_FILE *file; /*!< Opened on the game thread, closed by the decoder. */
+	char extension[16];
+	ALLEGRO_SAMPLE *sample; /*!< Result, NULL when decoding failed. */
+	double start;
+	bool done; /*!< Set by the decoder once sample is ready to be swapped in. */
+};
+
+/*! \brief Single asset registered by a gamestate. */
+struct AssetRecord {
+	enum AssetKind kind;
+	char owner[32]; /*!< Name of the gamestate which loaded the asset. */
+	char name[255]; /*!< Data file path or a descriptive name. */
+	char path[255]; /*!< Data file the asset was decoded from, empty for created assets. */
+	int size; /*!< Size the font was loaded with. */
+	void *asset;
+	void *parent; /*!< Sample played by a sample instance. */
+	size_t ram; /*!< Bytes held in system memory. */
+	size_t vram; /*!< Bytes held in video memory. */
+	int watch; /*!< Watch descriptor of the directory holding the file, -1 when not watched. */
+	bool dirty; /*!< The file has changed on disk since it was decoded. */
+	struct SampleReload *reload; /*!< Decoding of a changed sample in progress. */
+	struct CachedAsset *cached; /*!< Shared cache entry holding the asset, NULL for assets owned by the gamestate. */
+	struct AssetRecord *next;
+};
+
+/*! \brief Decoded asset shared by all gamestates which load it with the same parameters. */
+struct CachedAsset {
+	enum AssetKind kind;
+	char path[255];
+	int size; /*!< Font size, 0 for other kinds. */
+	void *asset;
+	size_t ram, vram;
+	int refs; /*!< Number of records using the asset; unused assets are kept until evicted. */
+	unsigned int used; /*!< Cache clock at the last use, for LRU eviction. */
+	struct CachedAsset *next;
+};
+
+/*! \brief Game-wide asset cache. */
+struct AssetCache {
+	struct CachedAsset *entries;
+	size_t limit; /*!< Bytes of RAM and VRAM above which unused assets get evicted. */
+	unsigned int clock;
+	int hits, misses;
+};
+
+/*! \brief Manifest entry of the spritesheet a character drew last, kept in the character's data. */
+struct CharacterFrames {
+	struct Spritesheet *spritesheet; /*!< The entry is looked up again once the character switches to another one. */
+	const struct SpriteManifestEntry *manifest; /*!< NULL for spritesheets which aren't in the manifest. */
+};
+
+ALLEGRO_BITMAP* LoadBitmapAsset(struct Game *game, char* owner, char* path);
+ALLEGRO_BITMAP* CreateBitmapAsset(struct Game *game, char* owner, char* name, int width, int height);
+ALLEGRO_SAMPLE* LoadSampleAsset(struct Game *game, char* owner, char* path);
+ALLEGRO_SAMPLE_INSTANCE* CreateSampleInstanceAsset(struct Game *game, char* owner, char* name, ALLEGRO_SAMPLE *sample);
+ALLEGRO_FONT* LoadFontAsset(struct Game *game, char* owner, char* path, int size);
+void DrawShadowedText(struct Game *game, ALLEGRO_FONT *font, ALLEGRO_COLOR color, float x, float y, int flags, char const* text);
+struct Character* CreateCharacterAsset(struct Game *game, char* name);
+void DestroyCharacterAsset(struct Game *game, struct Character *character);
+void RegisterSpritesheetAsset(struct Game *game, struct Character *character, char* name);
+void LoadSpritesheetAssets(struct Game *game, char* owner, struct Character *character);
+void DrawCharacterFrame(struct Game *game, struct Character *character, ALLEGRO_COLOR tint, int flags);
+
+void UntrackAssets(struct Game *game, char* owner);
+void DestroyAssetRecords(struct AssetRecord *records);
+void InitAssetCache(struct Game *game, struct AssetCache *cache);
+void DestroyAssetCache(struct AssetCache *cache);
+
+size_t GetAssetUsage(struct Game *game, char* owner, size_t *ram, size_t *vram);
+void DumpAssets(struct Game *game, char* owner);
+bool CheckAssetBudget(struct Game *game, char* owner);
+
+void ReloadAssets(struct Game *game, char* owner, void **slots[], int count);
+
+#endif
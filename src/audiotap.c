@@ -0,0 +1,119 @@
+/*! \file audiotap.c
+ *  \brief Observers of the mixed audio, sharing mixers' postprocess callbacks.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include <libsuperderpy.h>
+
+static void DispatchAudio(void *buf, unsigned int samples, void *userdata) {
+	struct TappedMixer *mixer = userdata;
+	struct AudioTap *tap;
+	if (!mixer->convert) {
+		for (tap = mixer->taps; tap; tap = tap->next) {
+			tap->callback(buf, samples, mixer->channels, tap->userdata);
+		}
+		return;
+	}
+	const int16_t *src = buf;
+	unsigned int chunk = AUDIO_TAP_SCRATCH / mixer->channels, done, i;
+	for (done = 0; done < samples; done += chunk) {
+		unsigned int count = (samples - done < chunk) ? samples - done : chunk;
+		for (i=0; i<count * mixer->channels; i++) {
+			mixer->scratch[i] = src[done * mixer->channels + i] / 32768.0;
+		}
+		for (tap = mixer->taps; tap; tap = tap->next) {
+			tap->callback(mixer->scratch, count, mixer->channels, tap->userdata);
+		}
+	}
+}
+
+/*! \brief Starts calling back with everything given mixer outputs; returns NULL for unsupported mixers.
+ *
+ * Taps are only changed while the postprocess callback is detached, which
+ * Allegro does under the mixer lock, so the audio thread never sees a list
+ * being modified and doesn't have to take any lock of its own.
+ */
+struct AudioTap* AddAudioTap(struct Game *game, ALLEGRO_MIXER *mixer, AudioTapCallback callback, void *userdata) {
+	if (!mixer) return NULL;
+	struct TappedMixer *tapped = game->data->taps;
+	while (tapped && (tapped->mixer != mixer)) {
+		tapped = tapped->next;
+	}
+	if (!tapped) {
+		ALLEGRO_AUDIO_DEPTH depth = al_get_mixer_depth(mixer);
+		if ((depth != ALLEGRO_AUDIO_DEPTH_FLOAT32) && (depth != ALLEGRO_AUDIO_DEPTH_INT16)) {
+			PrintConsole(game, "Can't tap a mixer with audio depth %d.", depth);
+			return NULL;
+		}
+		tapped = calloc(1, sizeof(struct TappedMixer));
+		tapped->mixer = mixer;
+		tapped->channels = al_get_channel_count(al_get_mixer_channels(mixer));
+		tapped->convert = depth == ALLEGRO_AUDIO_DEPTH_INT16;
+		if (tapped->convert) {
+			tapped->scratch = malloc(AUDIO_TAP_SCRATCH * sizeof(float));
+		}
+		tapped->next = game->data->taps;
+		game->data->taps = tapped;
+	}
+
+	struct AudioTap *tap = calloc(1, sizeof(struct AudioTap));
+	tap->callback = callback;
+	tap->userdata = userdata;
+	al_set_mixer_postprocess_callback(mixer, NULL, NULL);
+	tap->next = tapped->taps;
+	tapped->taps = tap;
+	al_set_mixer_postprocess_callback(mixer, DispatchAudio, tapped);
+	return tap;
+}
+
+/*! \brief Stops the tap; once this returns, its callback is guaranteed not to run anymore.
+ *
+ * Works after DestroyGameData too, which has detached all taps already.
+ */
+void RemoveAudioTap(struct Game *game, struct AudioTap *tap) {
+	if (!tap) return;
+	struct TappedMixer *tapped;
+	for (tapped = game->data ? game->data->taps : NULL; tapped; tapped = tapped->next) {
+		struct AudioTap **prev = &tapped->taps;
+		while (*prev && (*prev != tap)) {
+			prev = &(*prev)->next;
+		}
+		if (!*prev) continue;
+		al_set_mixer_postprocess_callback(tapped->mixer, NULL, NULL);
+		*prev = tap->next;
+		if (tapped->taps) {
+			al_set_mixer_postprocess_callback(tapped->mixer, DispatchAudio, tapped);
+		}
+		break;
+	}
+	free(tap);
+}
+
+/*! \brief Detaches the mixers' postprocess callbacks and frees the bookkeeping; taps still left are only freed by RemoveAudioTap. */
+void DestroyAudioTaps(struct TappedMixer *mixers) {
+	while (mixers) {
+		struct TappedMixer *next = mixers->next;
+		// the audio thread may be about to call in with this very TappedMixer
+		al_set_mixer_postprocess_callback(mixers->mixer, NULL, NULL);
+		free(mixers->scratch);
+		free(mixers);
+		mixers = next;
+	}
+}
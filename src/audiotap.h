@@ -0,0 +1,37 @@
+#ifndef RADIOEDIT_AUDIOTAP_H
+#define RADIOEDIT_AUDIOTAP_H
+
+#include <allegro5/allegro_audio.h>
+
+#define AUDIO_TAP_SCRATCH 4096 /*!< Samples converted to float at once for integer mixers. */
+
+struct Game;
+
+/*! \brief Called on the audio thread with float samples (interleaved channels) mixed by the mixer.
+ *
+ * It runs while the mixer is locked, so it must never block or allocate.
+ */
+typedef void (*AudioTapCallback)(const float *buffer, unsigned int samples, int channels, void *userdata);
+
+/*! \brief Observer of a mixer's output. */
+struct AudioTap {
+	AudioTapCallback callback;
+	void *userdata;
+	struct AudioTap *next;
+};
+
+/*! \brief Mixer with its postprocess callback dispatching to taps. */
+struct TappedMixer {
+	ALLEGRO_MIXER *mixer;
+	int channels;
+	bool convert; /*!< The mixer isn't float, so samples go through the scratch buffer. */
+	float *scratch;
+	struct AudioTap *taps;
+	struct TappedMixer *next;
+};
+
+struct AudioTap* AddAudioTap(struct Game *game, ALLEGRO_MIXER *mixer, AudioTapCallback callback, void *userdata);
+void RemoveAudioTap(struct Game *game, struct AudioTap *tap);
+void DestroyAudioTaps(struct TappedMixer *mixers);
+
+#endif
@@ -0,0 +1,115 @@
+/*! \file beatmap.c
+ *  \brief Beat grids of music tracks, detected at build time.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include <libsuperderpy.h>
+
+static bool ReadBeatMap(struct Game *game, struct BeatMap *map, char* path) {
+	ALLEGRO_FILE *file = OpenDataFile(game, path);
+	if (!file) return false;
+	char magic[4];
+	int count = 0;
+	if ((al_fread(file, magic, 4) == 4) && !memcmp(magic, BEATMAP_MAGIC, 4)) {
+		al_fread32le(file); // sample rate, the game plays tracks at their own
+		map->length = al_fread32le(file);
+		count = al_fread32le(file);
+	}
+	unsigned char *data = (count > 0) ? malloc((size_t)count * 4) : NULL;
+	if (data && map->length && (al_fread(file, data, (size_t)count * 4) == (size_t)count * 4)) {
+		map->beats = malloc(count * sizeof(unsigned int));
+		int i;
+		for (i=0; i<count; i++) {
+			const unsigned char *b = data + i * 4;
+			map->beats[i] = b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned int)b[3] << 24);
+		}
+		map->count = count;
+	} else {
+		PrintConsole(game, "Beat map %s is invalid, ignoring.", path);
+	}
+	free(data);
+	al_fclose(file);
+	return map->count > 0;
+}
+
+/*! \brief Loads the beat map generated for given track, falling back to a beat every BEATMAP_DEFAULT_PERIOD samples. */
+void LoadBeatMap(struct Game *game, struct BeatMap *map, char* path, ALLEGRO_SAMPLE *sample) {
+	char name[255];
+	char *ext = strrchr(path, '.');
+	snprintf(name, sizeof(name), "%.*s%s", ext ? (int)(ext - path) : (int)strlen(path), path, BEATMAP_EXTENSION);
+	map->count = 0;
+	map->beats = NULL;
+	map->period = 0;
+	if (DataFileExists(game, name) && ReadBeatMap(game, map, name)) {
+		PrintConsole(game, "Beat map %s: %d beats.", name, map->count);
+		return;
+	}
+	map->length = sample ? al_get_sample_length(sample) : 0;
+	map->period = BEATMAP_DEFAULT_PERIOD;
+}
+
+void DestroyBeatMap(struct BeatMap *map) {
+	free(map->beats);
+	map->beats = NULL;
+	map->count = 0;
+}
+
+/*! \brief Index of the beat playing at given sample position.
+ *
+ * Positions before the first beat belong to the last one, as tracks loop.
+ * The fallback grid keeps counting past the end of the track instead, the
+ * same position / 44118 the chord bank was picked with before beat maps, so
+ * without one chords switch exactly as they used to around the loop point.
+ */
+int GetBeat(struct BeatMap *map, unsigned int position) {
+	if (map->period) return position / map->period;
+	if (!map->count) return 0;
+	position %= map->length;
+	int low = 0, high = map->count;
+	while (low < high) {
+		int mid = (low + high) / 2;
+		if (map->beats[mid] <= position) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low ? low - 1 : map->count - 1;
+}
+
+/*! \brief Index of the grid step at given sample position, with every beat divided into given number of steps.
+ *
+ * Changes exactly when playback crosses a step, so comparing it with the value
+ * from the previous tick tells whether something should happen on the grid.
+ */
+int GetBeatStep(struct BeatMap *map, unsigned int position, int division) {
+	if (map->period) return (int)((uint64_t)position * division / map->period);
+	if (!map->count) return 0;
+	position %= map->length;
+	int beat = GetBeat(map, position);
+	int64_t start = map->beats[beat], end = (beat + 1 < map->count) ? map->beats[beat + 1] : map->beats[0] + (int64_t)map->length;
+	if (start > position) {
+		// wrapped around to the last beat of the previous loop
+		start -= map->length;
+		end -= map->length;
+	}
+	int step = (end > start) ? (int)((position - start) * division / (end - start)) : 0;
+	return beat * division + step;
+}
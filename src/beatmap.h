@@ -0,0 +1,35 @@
+#ifndef RADIOEDIT_BEATMAP_H
+#define RADIOEDIT_BEATMAP_H
+
+#include <stdint.h>
+
+#define BEATMAP_MAGIC "RBTS"
+#define BEATMAP_EXTENSION ".beats"
+#define BEATMAP_DEFAULT_PERIOD 44118 /*!< Samples per beat of menu.flac, used when there's no beat map. */
+
+/* Beat map file: magic, then little endian uint32 sample rate, track length
+ * in samples and beat count, followed by ascending uint32 sample positions
+ * of the beats. */
+
+#ifndef RADIOEDIT_BEATMAP_TOOL
+
+#include <allegro5/allegro_audio.h>
+
+struct Game;
+
+/*! \brief Beat positions of a music track. */
+struct BeatMap {
+	unsigned int length; /*!< Samples in the track; positions past it wrap around, as tracks loop. */
+	int count;
+	unsigned int *beats;
+	unsigned int period; /*!< Samples per beat of the fallback grid used without a beat map, 0 with one. */
+};
+
+void LoadBeatMap(struct Game *game, struct BeatMap *map, char* path, ALLEGRO_SAMPLE *sample);
+void DestroyBeatMap(struct BeatMap *map);
+int GetBeat(struct BeatMap *map, unsigned int position);
+int GetBeatStep(struct BeatMap *map, unsigned int position, int division);
+
+#endif
+
+#endif
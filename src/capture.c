@@ -0,0 +1,228 @@
+/*! \file capture.c
+ *  \brief Recording frames to disk without stalling the main thread.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Each frame is copied and scaled down to the viewport size on the GPU, then
+// read back CAPTURE_STAGING frames later, when the copy has surely finished.
+// A writer thread stores frames as capture-NNNNNN.ppm; turn them into
+// a video with e.g. ffmpeg -framerate 60 -i capture-%06d.ppm out.mkv
+// When drawing into a memory bitmap (headless runs) frames are read directly.
+
+#include "common.h"
+#include <libsuperderpy.h>
+
+static void* WriterThread(ALLEGRO_THREAD *thread, void *arg) {
+	struct FrameCapture *capture = arg;
+	char filename[1024];
+	al_lock_mutex(capture->mutex);
+	while (true) {
+		while (!capture->queued && !capture->done) {
+			al_wait_cond(capture->cond, capture->mutex);
+		}
+		if (!capture->queued) break;
+		unsigned char *pixels = capture->frames[capture->tail];
+		int number = capture->numbers[capture->tail];
+		al_unlock_mutex(capture->mutex);
+
+		snprintf(filename, sizeof(filename), "%s/capture-%06d.ppm", capture->dir, number);
+		FILE *file = fopen(filename, "wb");
+		if (file) {
+			fprintf(file, "P6\n%d %d\n255\n", capture->width, capture->height);
+			fwrite(pixels, 3, capture->width * capture->height, file);
+			fclose(file);
+		}
+
+		al_lock_mutex(capture->mutex);
+		capture->tail = (capture->tail + 1) % CAPTURE_QUEUE;
+		capture->queued--;
+	}
+	al_unlock_mutex(capture->mutex);
+	return NULL;
+}
+
+/*! \brief Samples the given rectangle of a locked bitmap into the next free queue slot. */
+static void SubmitFrame(struct FrameCapture *capture, int number, ALLEGRO_LOCKED_REGION *region, float x, float y, float w, float h) {
+	al_lock_mutex(capture->mutex);
+	if (capture->queued == CAPTURE_QUEUE) {
+		// the writer can't keep up; dropping is better than stalling the game
+		capture->dropped++;
+		al_unlock_mutex(capture->mutex);
+		return;
+	}
+	int slot = capture->head;
+	al_unlock_mutex(capture->mutex);
+
+	unsigned char *dst = capture->frames[slot];
+	float sx = w / capture->width, sy = h / capture->height;
+	int i, j;
+	for (j=0; j<capture->height; j++) {
+		const unsigned char *row = (const unsigned char*)region->data + (int)(y + (j + 0.5) * sy) * region->pitch;
+		for (i=0; i<capture->width; i++) {
+			const unsigned char *pixel = row + (int)(x + (i + 0.5) * sx) * 4;
+			*dst++ = pixel[0];
+			*dst++ = pixel[1];
+			*dst++ = pixel[2];
+		}
+	}
+
+	al_lock_mutex(capture->mutex);
+	capture->numbers[slot] = number;
+	capture->head = (capture->head + 1) % CAPTURE_QUEUE;
+	capture->queued++;
+	al_signal_cond(capture->cond);
+	al_unlock_mutex(capture->mutex);
+}
+
+static void ReadBackStaging(struct FrameCapture *capture, int slot) {
+	ALLEGRO_LOCKED_REGION *region = al_lock_bitmap(capture->staging[slot], ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY);
+	if (region) {
+		SubmitFrame(capture, capture->pending[slot], region, 0, 0, capture->width, capture->height);
+		al_unlock_bitmap(capture->staging[slot]);
+	}
+	capture->pending[slot] = -1;
+}
+
+/*! \brief Makes sure the GPU copies exist and match the size of the target. */
+static bool PrepareStaging(struct FrameCapture *capture, ALLEGRO_BITMAP *target) {
+	int width = al_get_bitmap_width(target), height = al_get_bitmap_height(target);
+	if (capture->scratch && (al_get_bitmap_width(capture->scratch) == width) && (al_get_bitmap_height(capture->scratch) == height)) {
+		return true;
+	}
+	int flags = al_get_new_bitmap_flags();
+	// no linear filtering, so the pixel art is scaled down without blurring
+	al_set_new_bitmap_flags(ALLEGRO_VIDEO_BITMAP);
+	if (capture->scratch) al_destroy_bitmap(capture->scratch);
+	capture->scratch = al_create_bitmap(width, height);
+	int i;
+	for (i=0; i<CAPTURE_STAGING; i++) {
+		if (!capture->staging[i]) {
+			capture->staging[i] = al_create_bitmap(capture->width, capture->height);
+		}
+	}
+	al_set_new_bitmap_flags(flags);
+	return capture->scratch && capture->staging[CAPTURE_STAGING-1];
+}
+
+struct FrameCapture* CreateFrameCapture(struct Game *game) {
+	char *dir = getenv("RADIOEDIT_CAPTURE");
+	if (!dir || !dir[0]) return NULL;
+	struct FrameCapture *capture = calloc(1, sizeof(struct FrameCapture));
+	capture->dir = strdup(dir);
+	capture->width = game->viewport.width;
+	capture->height = game->viewport.height;
+	int i;
+	for (i=0; i<CAPTURE_STAGING; i++) {
+		capture->pending[i] = -1;
+	}
+	for (i=0; i<CAPTURE_QUEUE; i++) {
+		capture->frames[i] = malloc(capture->width * capture->height * 3);
+	}
+	capture->mutex = al_create_mutex();
+	capture->cond = al_create_cond();
+	capture->thread = al_create_thread(WriterThread, capture);
+	al_start_thread(capture->thread);
+	PrintConsole(game, "Capturing %dx%d frames to %s.", capture->width, capture->height, capture->dir);
+	return capture;
+}
+
+/*! \brief Flushes frames still in flight and waits until they're written. */
+void DestroyFrameCapture(struct Game *game, struct FrameCapture *capture) {
+	if (!capture) return;
+	int i;
+	for (i=0; i<CAPTURE_STAGING; i++) {
+		int slot = (capture->frame + i) % CAPTURE_STAGING;
+		if (capture->pending[slot] >= 0) ReadBackStaging(capture, slot);
+	}
+
+	al_lock_mutex(capture->mutex);
+	capture->done = true;
+	al_signal_cond(capture->cond);
+	al_unlock_mutex(capture->mutex);
+	al_join_thread(capture->thread, NULL);
+	al_destroy_thread(capture->thread);
+	al_destroy_cond(capture->cond);
+	al_destroy_mutex(capture->mutex);
+
+	if (capture->frame) {
+		PrintConsole(game, "Captured %d frames (%d dropped), %.3f ms avg, %.3f ms max of main thread time per frame.",
+		             capture->frame, capture->dropped, capture->time / capture->frame * 1000, capture->max_time * 1000);
+	}
+
+	for (i=0; i<CAPTURE_STAGING; i++) {
+		if (capture->staging[i]) al_destroy_bitmap(capture->staging[i]);
+	}
+	if (capture->scratch) al_destroy_bitmap(capture->scratch);
+	for (i=0; i<CAPTURE_QUEUE; i++) {
+		free(capture->frames[i]);
+	}
+	free(capture->dir);
+	free(capture);
+}
+
+/*! \brief Records the frame drawn so far into the current target; call at the end of Gamestate_Draw. */
+void CaptureFrame(struct Game *game) {
+	struct FrameCapture *capture = game->data ? game->data->capture : NULL;
+	if (!capture) return;
+	double start = al_get_time();
+
+	// the viewport is letterboxed and scaled up by libsuperderpy's projection
+	float x = 0, y = 0, x2 = capture->width, y2 = capture->height;
+	al_transform_coordinates(&game->projection, &x, &y);
+	al_transform_coordinates(&game->projection, &x2, &y2);
+
+	ALLEGRO_BITMAP *target = al_get_target_bitmap();
+	if (al_get_bitmap_flags(target) & ALLEGRO_MEMORY_BITMAP) {
+		ALLEGRO_LOCKED_REGION *region = al_lock_bitmap(target, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY);
+		if (region) {
+			SubmitFrame(capture, capture->frame, region, x, y, x2 - x, y2 - y);
+			al_unlock_bitmap(target);
+		}
+	} else if (PrepareStaging(capture, target)) {
+		int slot = capture->frame % CAPTURE_STAGING;
+		if (capture->pending[slot] >= 0) {
+			ReadBackStaging(capture, slot);
+		}
+
+		ALLEGRO_TRANSFORM transform, identity;
+		al_copy_transform(&transform, al_get_current_transform());
+		al_identity_transform(&identity);
+		int op, src, dst;
+		al_get_blender(&op, &src, &dst);
+
+		al_set_target_bitmap(capture->scratch);
+		al_use_transform(&identity);
+		al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+		al_draw_bitmap(target, 0, 0, 0);
+		al_set_target_bitmap(capture->staging[slot]);
+		al_use_transform(&identity);
+		al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+		al_draw_scaled_bitmap(capture->scratch, x, y, x2 - x, y2 - y, 0, 0, capture->width, capture->height, 0);
+
+		al_set_target_bitmap(target);
+		al_use_transform(&transform);
+		al_set_blender(op, src, dst);
+		capture->pending[slot] = capture->frame;
+	}
+	capture->frame++;
+
+	double time = al_get_time() - start;
+	capture->time += time;
+	if (time > capture->max_time) capture->max_time = time;
+}
@@ -0,0 +1,39 @@
+#ifndef RADIOEDIT_CAPTURE_H
+#define RADIOEDIT_CAPTURE_H
+
+#include <allegro5/allegro.h>
+
+struct Game;
+
+/*! \brief Frames copied on the GPU and waiting to be read back. */
+#define CAPTURE_STAGING 3
+/*! \brief Frames read back and waiting for the writer thread. */
+#define CAPTURE_QUEUE 16
+
+/*! \brief Frame recorder, enabled by pointing RADIOEDIT_CAPTURE to an existing directory. */
+struct FrameCapture {
+	char *dir;
+	int width, height; /*!< Size of recorded frames, which is the game viewport. */
+
+	ALLEGRO_BITMAP *scratch; /*!< Copy of the whole backbuffer. */
+	ALLEGRO_BITMAP *staging[CAPTURE_STAGING]; /*!< Viewport-sized copies being transferred. */
+	int pending[CAPTURE_STAGING]; /*!< Frame held by the staging bitmap, -1 if none. */
+
+	unsigned char *frames[CAPTURE_QUEUE]; /*!< RGB pixels of read back frames. */
+	int numbers[CAPTURE_QUEUE];
+	int head, tail, queued;
+	bool done;
+	ALLEGRO_THREAD *thread;
+	ALLEGRO_MUTEX *mutex;
+	ALLEGRO_COND *cond;
+
+	int frame; /*!< Number of the next captured frame. */
+	int dropped;
+	double time, max_time; /*!< Main thread time spent capturing, in seconds. */
+};
+
+struct FrameCapture* CreateFrameCapture(struct Game *game);
+void DestroyFrameCapture(struct Game *game, struct FrameCapture *capture);
+void CaptureFrame(struct Game *game);
+
+#endif
@@ -23,10 +23,60 @@
 #include <libsuperderpy.h>
 
 struct CommonResources* CreateGameData(struct Game *game) {
-	return calloc(1, sizeof(struct CommonResources));
+	struct CommonResources *resources = calloc(1, sizeof(struct CommonResources));
+	resources->datadir = FindDataDirectory(game);
+	resources->archive = OpenDataArchive(game, resources->datadir);
+	InitAssetCache(game, &resources->cache);
+	InitPalette(game, &resources->palette);
+	InitQualityGovernor(game, &resources->governor);
+	resources->compositor = CreateCompositor(game);
+	if (game->config.debug) {
+		resources->watcher = CreateAssetWatcher(game);
+	}
+	resources->capture = CreateFrameCapture(game);
+	resources->telemetry = CreateTelemetry(game);
+	resources->latency = CreateLatencyProbe(game);
+	return resources;
 }
 
 void DestroyGameData(struct Game *game, struct CommonResources *resources) {
+	DestroyAssetRecords(resources->assets);
+	DestroyAssetCache(&resources->cache);
+	DestroyPalette(&resources->palette);
+	DestroyCompositor(resources->compositor);
+	CloseDataArchive(resources->archive);
+	free(resources->datadir);
+	DestroyAssetWatcher(resources->watcher);
+	DestroyFrameCapture(game, resources->capture);
+	DestroyTelemetry(game, resources->telemetry);
+	DestroyLatencyProbe(game, resources->latency);
+	DestroyAudioTaps(resources->taps);
+	resources->taps = NULL;
 	free(resources);
 }
 
+
+/*! \brief Marks the common resources as used by a gamestate; call at the start of Gamestate_Load. */
+void HoldGameData(struct Game *game) {
+	// loading may happen on libsuperderpy's loading thread
+	__atomic_add_fetch(&game->data->users, 1, __ATOMIC_ACQ_REL);
+}
+
+/*! \brief Call at the very end of Gamestate_Unload; after CloseGameData, the last one destroys the common resources. */
+void ReleaseGameData(struct Game *game) {
+	struct CommonResources *resources = game->data;
+	if (!__atomic_sub_fetch(&resources->users, 1, __ATOMIC_ACQ_REL) && resources->closing) {
+		DestroyGameData(game, resources);
+		game->data = NULL;
+	}
+}
+
+/*! \brief Destroys the common resources once no gamestate is loaded, which on closing the window is only inside libsuperderpy_destroy. */
+void CloseGameData(struct Game *game) {
+	struct CommonResources *resources = game->data;
+	resources->closing = true;
+	if (!__atomic_load_n(&resources->users, __ATOMIC_ACQUIRE)) {
+		DestroyGameData(game, resources);
+		game->data = NULL;
+	}
+}
@@ -1,9 +1,49 @@
 #define LIBSUPERDERPY_DATA_TYPE struct CommonResources
 #include <libsuperderpy.h>
+#include "alloctrack.h"
+#include "archive.h"
+#include "assets.h"
+#include "audiotap.h"
+#include "beatmap.h"
+#include "capture.h"
+#include "compositor.h"
+#include "fontbake.h"
+#include "governor.h"
+#include "hotreload.h"
+#include "input.h"
+#include "lanelayout.h"
+#include "latency.h"
+#include "log.h"
+#include "palette.h"
+#include "particles.h"
+#include "random.h"
+#include "schedule.h"
+#include "snapshot.h"
+#include "spectrum.h"
+#include "spritemanifest.h"
+#include "telemetry.h"
+#include "trace.h"
 
 struct CommonResources {
   // Fill in with common data accessible from all gamestates.
+  struct AssetRecord *assets; /*!< Memory accounting of loaded assets. */
+  struct AssetCache cache; /*!< Decoded assets shared between gamestates and their reloads. */
+  char *datadir; /*!< Where libsuperderpy finds data files, with a trailing slash. */
+  struct DataArchive *archive; /*!< Packed game data, NULL when running from loose files. */
+  struct AssetWatcher *watcher; /*!< Hot-reload of changed data files, only in debug mode. */
+  struct Palette palette; /*!< Shared palette of indexed pixel-art bitmaps. */
+  struct TappedMixer *taps; /*!< Mixers observed by audio taps. */
+  struct QualityGovernor governor; /*!< Optional effects traded for frame time. */
+  struct Compositor *compositor; /*!< CPU renderer of the scene, NULL when the GPU draws it. */
+  struct FrameCapture *capture; /*!< Frame recorder, NULL unless RADIOEDIT_CAPTURE is set. */
+  struct Telemetry *telemetry; /*!< Gameplay metrics recorder, NULL unless RADIOEDIT_TELEMETRY is set. */
+  struct LatencyProbe *latency; /*!< Key to audio latency harness, NULL unless RADIOEDIT_LATENCY is set. */
+  int users; /*!< Loaded gamestates, which may use any of the above until they're unloaded. */
+  bool closing; /*!< The main loop finished, so the last gamestate to be unloaded destroys the resources. */
 };
 
 struct CommonResources* CreateGameData(struct Game *game);
 void DestroyGameData(struct Game *game, struct CommonResources *resources);
+void HoldGameData(struct Game *game);
+void ReleaseGameData(struct Game *game);
+void CloseGameData(struct Game *game);
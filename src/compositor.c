@@ -0,0 +1,380 @@
+/*! \file compositor.c
+ *  \brief Drawing the scene on the CPU when there's no GPU to do it.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include <libsuperderpy.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define COMPOSITOR_AVX2
+#endif
+
+/*! \brief x * y / 255, rounded, for x and y up to 255. */
+static inline uint32_t Mul255(uint32_t x, uint32_t y) {
+	uint32_t v = x * y + 128;
+	return (v + (v >> 8)) >> 8;
+}
+
+static void BlendRowScalar(uint32_t *dst, const uint32_t *src, int count, const uint16_t tint[4], bool tinted) {
+	int i, c;
+	for (i=0; i<count; i++) {
+		uint32_t s = src[i];
+		if (!s) continue;
+		if (tinted) {
+			uint32_t t = 0;
+			for (c=0; c<4; c++) {
+				t |= Mul255((s >> (c * 8)) & 0xff, tint[c]) << (c * 8);
+			}
+			s = t;
+		}
+		uint32_t inverse = 255 - (s >> 24);
+		if (!inverse) {
+			dst[i] = s;
+			continue;
+		}
+		uint32_t d = dst[i], result = 0;
+		for (c=0; c<4; c++) {
+			// a tint brighter than its alpha can push channels over, saturate like the SIMD packing does
+			uint32_t v = ((s >> (c * 8)) & 0xff) + Mul255((d >> (c * 8)) & 0xff, inverse);
+			result |= (v > 255 ? 255 : v) << (c * 8);
+		}
+		dst[i] = result;
+	}
+}
+
+#ifdef __SSE2__
+/*! \brief x * y / 255 on 16-bit lanes holding values up to 255; (v + 128) * 257 >> 16 is exact there. */
+static inline __m128i Mul255SSE2(__m128i x, __m128i y) {
+	return _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(x, y), _mm_set1_epi16(128)), _mm_set1_epi16(257));
+}
+
+/*! \brief Source over destination for two pixels spread to 16-bit lanes. */
+static inline __m128i BlendSSE2(__m128i s, __m128i d) {
+	__m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm_add_epi16(s, Mul255SSE2(d, _mm_sub_epi16(_mm_set1_epi16(255), alpha)));
+}
+
+static void BlendRowSSE2(uint32_t *dst, const uint32_t *src, int count, const uint16_t tint[4], bool tinted) {
+	const __m128i zero = _mm_setzero_si128(), opaque = _mm_set1_epi32(0xff000000);
+	const __m128i t = _mm_setr_epi16(tint[0], tint[1], tint[2], tint[3], tint[0], tint[1], tint[2], tint[3]);
+	int i;
+	for (i=0; i+4<=count; i+=4) {
+		__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+		// transparent areas of sprites are common and need no work at all
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xffff) continue;
+		if (!tinted && (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, opaque), opaque)) == 0xffff)) {
+			_mm_storeu_si128((__m128i*)(dst + i), s);
+			continue;
+		}
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+		__m128i slo = _mm_unpacklo_epi8(s, zero), shi = _mm_unpackhi_epi8(s, zero);
+		if (tinted) {
+			slo = Mul255SSE2(slo, t);
+			shi = Mul255SSE2(shi, t);
+		}
+		__m128i lo = BlendSSE2(slo, _mm_unpacklo_epi8(d, zero));
+		__m128i hi = BlendSSE2(shi, _mm_unpackhi_epi8(d, zero));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+	BlendRowScalar(dst + i, src + i, count - i, tint, tinted);
+}
+#endif
+
+#ifdef COMPOSITOR_AVX2
+__attribute__((target("avx2"))) static inline __m256i Mul255AVX2(__m256i x, __m256i y) {
+	return _mm256_mulhi_epu16(_mm256_add_epi16(_mm256_mullo_epi16(x, y), _mm256_set1_epi16(128)), _mm256_set1_epi16(257));
+}
+
+__attribute__((target("avx2"))) static inline __m256i BlendAVX2(__m256i s, __m256i d) {
+	__m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm256_add_epi16(s, Mul255AVX2(d, _mm256_sub_epi16(_mm256_set1_epi16(255), alpha)));
+}
+
+/*! \brief Same as BlendRowSSE2, eight pixels at a time; unpacking and packing both work within 128-bit halves, so pixel order is kept. */
+__attribute__((target("avx2"))) static void BlendRowAVX2(uint32_t *dst, const uint32_t *src, int count, const uint16_t tint[4], bool tinted) {
+	const __m256i zero = _mm256_setzero_si256(), opaque = _mm256_set1_epi32(0xff000000);
+	const __m256i t = _mm256_setr_epi16(tint[0], tint[1], tint[2], tint[3], tint[0], tint[1], tint[2], tint[3],
+	                                    tint[0], tint[1], tint[2], tint[3], tint[0], tint[1], tint[2], tint[3]);
+	int i;
+	for (i=0; i+8<=count; i+=8) {
+		__m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+		if (_mm256_testz_si256(s, s)) continue;
+		if (!tinted && ((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(s, opaque), opaque)) == 0xffffffffu)) {
+			_mm256_storeu_si256((__m256i*)(dst + i), s);
+			continue;
+		}
+		__m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+		__m256i slo = _mm256_unpacklo_epi8(s, zero), shi = _mm256_unpackhi_epi8(s, zero);
+		if (tinted) {
+			slo = Mul255AVX2(slo, t);
+			shi = Mul255AVX2(shi, t);
+		}
+		__m256i lo = BlendAVX2(slo, _mm256_unpacklo_epi8(d, zero));
+		__m256i hi = BlendAVX2(shi, _mm256_unpackhi_epi8(d, zero));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(lo, hi));
+	}
+	BlendRowScalar(dst + i, src + i, count - i, tint, tinted);
+}
+#endif
+
+static uint32_t PackColor(ALLEGRO_COLOR color) {
+	unsigned char r, g, b, a;
+	al_unmap_rgba(color, &r, &g, &b, &a);
+	return ((uint32_t)a << 24) | ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+}
+
+static bool ReadImage(struct Game *game, struct CompositorImage *image) {
+	ALLEGRO_BITMAP *bitmap = image->bitmap;
+	int width = al_get_bitmap_width(bitmap), height = al_get_bitmap_height(bitmap), x, y;
+	bool indexed = al_get_bitmap_format(bitmap) == ALLEGRO_PIXEL_FORMAT_SINGLE_CHANNEL_8;
+	ALLEGRO_LOCKED_REGION *region = al_lock_bitmap(bitmap, indexed ? ALLEGRO_PIXEL_FORMAT_SINGLE_CHANNEL_8 : ALLEGRO_PIXEL_FORMAT_ARGB_8888, ALLEGRO_LOCK_READONLY);
+	if (!region) return false;
+	if ((width != image->width) || (height != image->height)) {
+		free(image->pixels);
+		image->pixels = malloc(width * height * sizeof(uint32_t));
+		image->width = width;
+		image->height = height;
+	}
+	uint32_t colors[PALETTE_SIZE];
+	if (indexed) {
+		struct Palette *palette = &game->data->palette;
+		for (x=0; x<PALETTE_SIZE; x++) {
+			unsigned char *c = palette->colors[x];
+			colors[x] = ((uint32_t)c[3] << 24) | (Mul255(c[0], c[3]) << 16) | (Mul255(c[1], c[3]) << 8) | Mul255(c[2], c[3]);
+		}
+	}
+	for (y=0; y<height; y++) {
+		const unsigned char *row = (const unsigned char*)region->data + y * region->pitch;
+		uint32_t *out = image->pixels + y * width;
+		if (indexed) {
+			for (x=0; x<width; x++) {
+				out[x] = colors[row[x]];
+			}
+		} else {
+			memcpy(out, row, width * sizeof(uint32_t));
+		}
+	}
+	al_unlock_bitmap(bitmap);
+	image->stale = false;
+	return true;
+}
+
+static struct CompositorImage* GetImage(struct Game *game, ALLEGRO_BITMAP *bitmap) {
+	struct Compositor *compositor = game->data->compositor;
+	struct CompositorImage *image = compositor->images;
+	while (image && (image->bitmap != bitmap)) {
+		image = image->next;
+	}
+	if (!image) {
+		image = calloc(1, sizeof(struct CompositorImage));
+		image->bitmap = bitmap;
+		image->stale = true;
+		image->next = compositor->images;
+		compositor->images = image;
+	}
+	if (image->stale && !ReadImage(game, image)) return NULL;
+	return image;
+}
+
+static void FreeImages(struct CompositorImage *image) {
+	while (image) {
+		struct CompositorImage *next = image->next;
+		free(image->pixels);
+		free(image);
+		image = next;
+	}
+}
+
+/*! \brief Integer position matching where Allegro's nearest sampling puts a bitmap drawn at v. */
+static int SnapPosition(float v) {
+	return (int)ceilf(v - 0.5f);
+}
+
+/*! \brief Returns a compositor when frames should be composited on the CPU, NULL otherwise. */
+struct Compositor* CreateCompositor(struct Game *game) {
+	char *env = getenv("RADIOEDIT_COMPOSITOR");
+	bool enabled = (env && env[0]) ? atoi(env) : (al_get_display_option(game->display, ALLEGRO_RENDER_METHOD) == 0);
+	if (!enabled) return NULL;
+
+	struct Compositor *compositor = calloc(1, sizeof(struct Compositor));
+	compositor->width = game->viewport.width;
+	compositor->height = game->viewport.height;
+	compositor->frame = calloc(compositor->width * compositor->height, sizeof(uint32_t));
+	compositor->row = malloc(compositor->width * sizeof(uint32_t));
+	compositor->upload = al_create_bitmap(compositor->width, compositor->height);
+	char *kernel = "scalar";
+	compositor->blend = BlendRowScalar;
+#ifdef __SSE2__
+	kernel = "SSE2";
+	compositor->blend = BlendRowSSE2;
+#endif
+#ifdef COMPOSITOR_AVX2
+	if (__builtin_cpu_supports("avx2")) {
+		kernel = "AVX2";
+		compositor->blend = BlendRowAVX2;
+	}
+#endif
+	PrintConsole(game, "Compositing %dx%d frames on the CPU (%s).", compositor->width, compositor->height, kernel);
+	return compositor;
+}
+
+void DestroyCompositor(struct Compositor *compositor) {
+	if (!compositor) return;
+	FreeImages(compositor->images);
+	al_destroy_bitmap(compositor->upload);
+	free(compositor->row);
+	free(compositor->frame);
+	free(compositor);
+}
+
+/*! \brief Starts compositing a frame, if frames are composited at all; drawing with Allegro then has to wait for PresentComposition. */
+bool BeginComposition(struct Game *game) {
+	struct Compositor *compositor = game->data->compositor;
+	if (!compositor) return false;
+	compositor->active = true;
+	return true;
+}
+
+bool IsCompositing(struct Game *game) {
+	return game->data && game->data->compositor && game->data->compositor->active;
+}
+
+void CompositeClear(struct Game *game, ALLEGRO_COLOR color) {
+	struct Compositor *compositor = game->data->compositor;
+	uint32_t value = PackColor(color);
+	int i, count = compositor->width * compositor->height;
+	for (i=0; i<count; i++) {
+		compositor->frame[i] = value;
+	}
+}
+
+/*! \brief Blends part of a bitmap, scaled to dw x dh with nearest sampling; rotation isn't supported. */
+void CompositeBitmapRegion(struct Game *game, ALLEGRO_BITMAP *bitmap, ALLEGRO_COLOR tint, int sx, int sy, int sw, int sh, float dx, float dy, float dw, float dh, int flags) {
+	struct Compositor *compositor = game->data->compositor;
+	struct CompositorImage *image = GetImage(game, bitmap);
+	if (!image) return;
+	if (sx < 0) { sw += sx; sx = 0; }
+	if (sy < 0) { sh += sy; sy = 0; }
+	if (sx + sw > image->width) sw = image->width - sx;
+	if (sy + sh > image->height) sh = image->height - sy;
+
+	int left = SnapPosition(dx), top = SnapPosition(dy);
+	int width = SnapPosition(dx + dw) - left, height = SnapPosition(dy + dh) - top;
+	if ((sw <= 0) || (sh <= 0) || (width <= 0) || (height <= 0)) return;
+	int x0 = left < 0 ? 0 : left, x1 = left + width > compositor->width ? compositor->width : left + width;
+	int y0 = top < 0 ? 0 : top, y1 = top + height > compositor->height ? compositor->height : top + height;
+	if ((x0 >= x1) || (y0 >= y1)) return;
+
+	// Allegro colors are used as given, so tinting multiplies premultiplied pixels directly
+	uint32_t packed = PackColor(tint);
+	if (!packed) return;
+	uint16_t t[4] = { packed & 0xff, (packed >> 8) & 0xff, (packed >> 16) & 0xff, packed >> 24 };
+	bool tinted = packed != 0xffffffff;
+	bool direct = (width == sw) && !(flags & ALLEGRO_FLIP_HORIZONTAL);
+
+	int x, y;
+	for (y=y0; y<y1; y++) {
+		// sample at pixel centers, like the GPU does
+		int v = ((2 * (y - top) + 1) * sh) / (2 * height);
+		if (flags & ALLEGRO_FLIP_VERTICAL) v = sh - 1 - v;
+		const uint32_t *line = image->pixels + (sy + v) * image->width + sx;
+		const uint32_t *src;
+		if (direct) {
+			src = line + (x0 - left);
+		} else {
+			for (x=x0; x<x1; x++) {
+				int u = ((2 * (x - left) + 1) * sw) / (2 * width);
+				if (flags & ALLEGRO_FLIP_HORIZONTAL) u = sw - 1 - u;
+				compositor->row[x - x0] = line[u];
+			}
+			src = compositor->row;
+		}
+		compositor->blend(compositor->frame + y * compositor->width + x0, src, x1 - x0, t, tinted);
+	}
+}
+
+/*! \brief Blends a whole bitmap at its size. */
+void CompositeBitmap(struct Game *game, ALLEGRO_BITMAP *bitmap, ALLEGRO_COLOR tint, float x, float y, int flags) {
+	int width = al_get_bitmap_width(bitmap), height = al_get_bitmap_height(bitmap);
+	CompositeBitmapRegion(game, bitmap, tint, 0, 0, width, height, x, y, width, height, flags);
+}
+
+/*! \brief Darkens the top left pixel of every 2x2 block by alpha, like a black checkerboard bitmap would. */
+void CompositeCheckerboard(struct Game *game, int alpha) {
+	struct Compositor *compositor = game->data->compositor;
+	uint32_t keep = 255 - alpha;
+	int x, y;
+	for (y=0; y<compositor->height; y+=2) {
+		uint32_t *row = compositor->frame + y * compositor->width;
+		x = 0;
+#ifdef __SSE2__
+		const __m128i zero = _mm_setzero_si128();
+		// even pixels get scaled, odd ones are multiplied by 255 which leaves them as they were
+		const __m128i factor = _mm_setr_epi16(keep, keep, keep, keep, 255, 255, 255, 255);
+		for (; x+4<=compositor->width; x+=4) {
+			__m128i d = _mm_loadu_si128((const __m128i*)(row + x));
+			__m128i lo = Mul255SSE2(_mm_unpacklo_epi8(d, zero), factor);
+			__m128i hi = Mul255SSE2(_mm_unpackhi_epi8(d, zero), factor);
+			_mm_storeu_si128((__m128i*)(row + x), _mm_packus_epi16(lo, hi));
+		}
+#endif
+		for (; x<compositor->width; x+=2) {
+			uint32_t d = row[x];
+			row[x] = (Mul255(d >> 24, keep) << 24) | (Mul255((d >> 16) & 0xff, keep) << 16) | (Mul255((d >> 8) & 0xff, keep) << 8) | Mul255(d & 0xff, keep);
+		}
+	}
+}
+
+/*! \brief Uploads the composited frame in one go and draws it to the target bitmap. */
+void PresentComposition(struct Game *game) {
+	struct Compositor *compositor = game->data->compositor;
+	compositor->active = false;
+	ALLEGRO_LOCKED_REGION *region = al_lock_bitmap(compositor->upload, ALLEGRO_PIXEL_FORMAT_ARGB_8888, ALLEGRO_LOCK_WRITEONLY);
+	if (!region) return;
+	int y;
+	for (y=0; y<compositor->height; y++) {
+		memcpy((unsigned char*)region->data + y * region->pitch, compositor->frame + y * compositor->width, compositor->width * sizeof(uint32_t));
+	}
+	al_unlock_bitmap(compositor->upload);
+	al_draw_bitmap(compositor->upload, 0, 0, 0);
+}
+
+/*! \brief Makes the compositor read given bitmap again, after it has been drawn to. */
+void RefreshCompositorImage(struct Game *game, ALLEGRO_BITMAP *bitmap) {
+	struct Compositor *compositor = game->data ? game->data->compositor : NULL;
+	if (!compositor) return;
+	struct CompositorImage *image = compositor->images;
+	while (image) {
+		if (image->bitmap == bitmap) image->stale = true;
+		image = image->next;
+	}
+}
+
+/*! \brief Drops all read bitmaps, as some of them are about to be destroyed or were replaced. */
+void ForgetCompositorImages(struct Game *game) {
+	struct Compositor *compositor = game->data ? game->data->compositor : NULL;
+	if (!compositor) return;
+	FreeImages(compositor->images);
+	compositor->images = NULL;
+}
@@ -0,0 +1,49 @@
+#ifndef RADIOEDIT_COMPOSITOR_H
+#define RADIOEDIT_COMPOSITOR_H
+
+#include <stdint.h>
+#include <allegro5/allegro.h>
+
+struct Game;
+
+/*! \brief Blends a row of premultiplied source pixels over the destination, multiplied by tint (BGRA, 0-255) unless it's white. */
+typedef void (*CompositorBlendRow)(uint32_t *dst, const uint32_t *src, int count, const uint16_t tint[4], bool tinted);
+
+/*! \brief Pixels of a bitmap as composited, premultiplied ARGB like the frame. */
+struct CompositorImage {
+	ALLEGRO_BITMAP *bitmap;
+	int width, height;
+	uint32_t *pixels;
+	bool stale; /*!< The bitmap was drawn to, so pixels are read again on next use. */
+	struct CompositorImage *next;
+};
+
+/*! \brief Software renderer of the viewport-sized scene, for displays without GPU acceleration.
+ *
+ * Enabled automatically when Allegro reports software rendering, or forced on
+ * or off by setting RADIOEDIT_COMPOSITOR to 1 or 0. Text isn't composited, so
+ * it's drawn by Allegro after the composited frame is presented.
+ */
+struct Compositor {
+	int width, height;
+	uint32_t *frame; /*!< Premultiplied ARGB pixels of the scene being composited. */
+	uint32_t *row; /*!< Source pixels gathered for scaled or flipped blits. */
+	ALLEGRO_BITMAP *upload; /*!< Bitmap the finished frame is copied into and drawn from. */
+	struct CompositorImage *images; /*!< Bitmaps composited so far, read when first used. */
+	CompositorBlendRow blend;
+	bool active; /*!< Between BeginComposition and PresentComposition. */
+};
+
+struct Compositor* CreateCompositor(struct Game *game);
+void DestroyCompositor(struct Compositor *compositor);
+bool BeginComposition(struct Game *game);
+bool IsCompositing(struct Game *game);
+void CompositeClear(struct Game *game, ALLEGRO_COLOR color);
+void CompositeBitmap(struct Game *game, ALLEGRO_BITMAP *bitmap, ALLEGRO_COLOR tint, float x, float y, int flags);
+void CompositeBitmapRegion(struct Game *game, ALLEGRO_BITMAP *bitmap, ALLEGRO_COLOR tint, int sx, int sy, int sw, int sh, float dx, float dy, float dw, float dh, int flags);
+void CompositeCheckerboard(struct Game *game, int alpha);
+void PresentComposition(struct Game *game);
+void RefreshCompositorImage(struct Game *game, ALLEGRO_BITMAP *bitmap);
+void ForgetCompositorImages(struct Game *game);
+
+#endif
@@ -0,0 +1,94 @@
+/*! \file fontbake.c
+ *  \brief Rasterizing TTF fonts into bitmap font atlases.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Atlases use the layout expected by al_grab_font_from_bitmap: glyph cells
+// separated by a one pixel border in the colour of the top-left pixel.
+// This file is shared by the game and the radioedit-bakefont build tool.
+
+#include <stdio.h>
+#include <string.h>
+#include <allegro5/allegro_primitives.h>
+#include "fontbake.h"
+
+#define ATLAS_MAX_WIDTH 512
+
+/*! \brief Renders all baked characters of the font into an atlas.
+ *
+ * Glyphs are baked plain in white, so they can be tinted with any colour;
+ * DrawShadowedText draws the drop shadow from the same glyphs.
+ */
+ALLEGRO_BITMAP* BakeFontAtlas(ALLEGRO_FONT *font) {
+	int count = BAKED_FONT_LAST - BAKED_FONT_FIRST + 1;
+	int widths[BAKED_FONT_LAST - BAKED_FONT_FIRST + 1];
+	int height = al_get_font_line_height(font);
+	int i, x = 1, y = 1, width = 0;
+
+	for (i=0; i<count; i++) {
+		char glyph[2] = { BAKED_FONT_FIRST + i, 0 };
+		widths[i] = al_get_text_width(font, glyph);
+		if (widths[i] < 1) widths[i] = 1;
+		if (x + widths[i] + 1 > ATLAS_MAX_WIDTH) {
+			x = 1;
+			y += height + 1;
+		}
+		x += widths[i] + 1;
+		if (x > width) width = x;
+	}
+
+	ALLEGRO_BITMAP *atlas = al_create_bitmap(width, y + height + 1);
+	if (!atlas) return NULL;
+	ALLEGRO_BITMAP *target = al_get_target_bitmap();
+	int op, src, dst;
+	al_get_blender(&op, &src, &dst);
+
+	al_set_target_bitmap(atlas);
+	al_clear_to_color(al_map_rgb(255, 0, 255));
+	x = 1;
+	y = 1;
+	for (i=0; i<count; i++) {
+		char glyph[2] = { BAKED_FONT_FIRST + i, 0 };
+		if (x + widths[i] + 1 > ATLAS_MAX_WIDTH) {
+			x = 1;
+			y += height + 1;
+		}
+		al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+		al_draw_filled_rectangle(x, y, x + widths[i], y + height, al_map_rgba(0, 0, 0, 0));
+		al_set_blender(op, src, dst);
+		al_draw_text(font, al_map_rgb(255, 255, 255), x, y, ALLEGRO_ALIGN_LEFT, glyph);
+		x += widths[i] + 1;
+	}
+
+	if (target) al_set_target_bitmap(target);
+	return atlas;
+}
+
+ALLEGRO_FONT* GrabBakedFont(ALLEGRO_BITMAP *atlas) {
+	int ranges[] = { BAKED_FONT_FIRST, BAKED_FONT_LAST };
+	// the font keeps its own copy of the atlas
+	return al_grab_font_from_bitmap(atlas, 1, ranges);
+}
+
+/*! \brief Gives the data path of a pre-baked atlas, e.g. fonts/MonkeyIsland-8.png */
+void GetBakedFontName(char* path, int size, char* result, size_t length) {
+	char *ext = strrchr(path, '.');
+	int stem = ext ? (int)(ext - path) : (int)strlen(path);
+	snprintf(result, length, "%.*s-%d.png", stem, path, size);
+}
@@ -0,0 +1,15 @@
+#ifndef RADIOEDIT_FONTBAKE_H
+#define RADIOEDIT_FONTBAKE_H
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_font.h>
+
+/*! \brief First and last character baked into font atlases; all our texts are plain ASCII. */
+#define BAKED_FONT_FIRST 32
+#define BAKED_FONT_LAST 126
+
+ALLEGRO_BITMAP* BakeFontAtlas(ALLEGRO_FONT *font);
+ALLEGRO_FONT* GrabBakedFont(ALLEGRO_BITMAP *atlas);
+void GetBakedFontName(char* path, int size, char* result, size_t length);
+
+#endif
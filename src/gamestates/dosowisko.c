@@ -33,23 +33,23 @@ struct GamestateResources {
 		int pos, fade, tick, tan;
 		char text[255];
 		bool underscore, fadeout;
-		struct Timeline *timeline;
+		struct Schedule *schedule;
 };
 
 int Gamestate_ProgressCount = 5;
 
 static const char* text = "# dosowisko.net";
 
-//==================================Timeline manager actions BEGIN
-bool FadeIn(struct Game *game, struct TM_Action *action, enum TM_ActionState state) {
-	struct GamestateResources *data = TM_GetArg(action->arguments, 0);
-	if (state == TM_ACTIONSTATE_START) {
+//==================================Schedule actions BEGIN
+bool FadeIn(struct Game *game, struct ScheduledAction *action, enum ScheduleState state) {
+	struct GamestateResources *data = GetScheduleArg(action, 0);
+	if (state == SCHEDULE_START) {
 		data->fade=0;
 	}
-	else if (state == TM_ACTIONSTATE_DESTROY) {
+	else if (state == SCHEDULE_DESTROY) {
 		data->fade=255;
 	}
-	else if (state == TM_ACTIONSTATE_RUNNING) {
+	else if (state == SCHEDULE_RUNNING) {
 		data->fade+=2;
 		data->tan++;
 		return data->fade >= 255;
@@ -57,34 +57,34 @@ bool FadeIn(struct Game *game, struct TM_Action *action, enum TM_ActionState sta
 	return false;
 }
 
-bool FadeOut(struct Game *game, struct TM_Action *action, enum TM_ActionState state) {
-	struct GamestateResources *data = TM_GetArg(action->arguments, 0);
-	if (state == TM_ACTIONSTATE_START) {
+bool FadeOut(struct Game *game, struct ScheduledAction *action, enum ScheduleState state) {
+	struct GamestateResources *data = GetScheduleArg(action, 0);
+	if (state == SCHEDULE_START) {
 		data->fadeout = true;
 	}
 	return true;
 }
 
-bool End(struct Game *game, struct TM_Action *action, enum TM_ActionState state) {
-	if (state == TM_ACTIONSTATE_RUNNING) {
+bool End(struct Game *game, struct ScheduledAction *action, enum ScheduleState state) {
+	if (state == SCHEDULE_RUNNING) {
 		SwitchCurrentGamestate(game, "menu");
 	}
 	return true;
 }
 
-bool Play(struct Game *game, struct TM_Action *action, enum TM_ActionState state) {
-	ALLEGRO_SAMPLE_INSTANCE *data = TM_GetArg(action->arguments, 0);
-	if (state == TM_ACTIONSTATE_RUNNING) al_play_sample_instance(data);
+bool Play(struct Game *game, struct ScheduledAction *action, enum ScheduleState state) {
+	ALLEGRO_SAMPLE_INSTANCE *data = GetScheduleArg(action, 0);
+	if (state == SCHEDULE_RUNNING) al_play_sample_instance(data);
 	return true;
 }
 
-bool Type(struct Game *game, struct TM_Action *action, enum TM_ActionState state) {
-	struct GamestateResources *data = TM_GetArg(action->arguments, 0);
-	if (state == TM_ACTIONSTATE_RUNNING) {
+bool Type(struct Game *game, struct ScheduledAction *action, enum ScheduleState state) {
+	struct GamestateResources *data = GetScheduleArg(action, 0);
+	if (state == SCHEDULE_RUNNING) {
 		strncpy(data->text, text, data->pos++);
 		data->text[data->pos] = 0;
 		if (strcmp(data->text, text) != 0) {
-			TM_AddBackgroundAction(data->timeline, Type, TM_AddToArgs(NULL, 1, data), 60 + rand() % 60, "type");
+			RepeatAction(action, 60 + rand() % 60);
 		} else{
 			al_stop_sample_instance(data->kbd);
 		}
@@ -92,19 +92,58 @@ bool Type(struct Game *game, struct TM_Action *action, enum TM_ActionState state
 	}
 	return false;
 }
-//==================================Timeline manager actions END
+//==================================Schedule actions END
 
 
+void Gamestate_Reload(struct Game *game, struct GamestateResources* data);
+
 void Gamestate_Logic(struct Game *game, struct GamestateResources* data) {
-	TM_Process(data->timeline);
+	BeginAllocPhase(ALLOC_PHASE_LOGIC);
+	TraceFramePresented("dosowisko", false);
+	if (PollAssetChanges(game, "dosowisko")) {
+		Gamestate_Reload(game, data);
+	}
+	ProcessSchedule(data->schedule);
 	data->tick++;
 	if (data->tick == 30) {
 		data->underscore = !data->underscore;
 		data->tick = 0;
 	}
+	EndAllocPhase();
+}
+
+/*! \brief Same as the pixelator passes, but composited on the CPU and uploaded once. */
+static void DrawComposited(struct Game *game, struct GamestateResources* data, char *t, int fade) {
+	CompositeClear(game, al_map_rgb(35, 31, 32));
+
+	// glyphs still come from Allegro, so they're drawn into the text bitmap and read back
+	al_set_target_bitmap(data->bitmap);
+	al_clear_to_color(al_map_rgba(0,0,0,0));
+	al_draw_text(data->font, al_map_rgba(255,255,255,10), game->viewport.width/2,
+	             game->viewport.height*0.4167, ALLEGRO_ALIGN_CENTRE, t);
+	al_set_target_backbuffer(game->display);
+	RefreshCompositorImage(game, data->bitmap);
+
+	int w = al_get_bitmap_width(data->bitmap), h = al_get_bitmap_height(data->bitmap);
+	if (HasQuality(game, QUALITY_INTRO_ZOOM)) {
+		double tg = tan(-data->tan/384.0 * ALLEGRO_PI - ALLEGRO_PI/2);
+		CompositeBitmapRegion(game, data->bitmap, al_map_rgba(fade, fade, fade, fade), 0, 0, w, h,
+		                      -tg*w*0.05, -tg*h*0.05, w+tg*0.1*w, h+tg*0.1*h, 0);
+	} else {
+		CompositeBitmap(game, data->bitmap, al_map_rgba(fade, fade, fade, fade), 0, 0, 0);
+	}
+
+	if (HasQuality(game, QUALITY_CHECKERBOARD)) {
+		CompositeCheckerboard(game, 64);
+	}
+
+	PresentComposition(game);
 }
 
 void Gamestate_Draw(struct Game *game, struct GamestateResources* data) {
+	BeginAllocPhase(ALLOC_PHASE_DRAW);
+	TraceFramePresented("dosowisko", false);
+	BeginGovernedFrame(game);
 
 	if (!data->fadeout) {
 
@@ -116,34 +155,54 @@ void Gamestate_Draw(struct Game *game, struct GamestateResources* data) {
 			strncat(t, " ", 1);
 		}
 
-		al_set_target_bitmap(data->bitmap);
-		al_clear_to_color(al_map_rgba(0,0,0,0));
+		int fade = data->fadeout ? 255 : data->fade;
 
-		al_draw_text(data->font, al_map_rgba(255,255,255,10), game->viewport.width/2,
-		             game->viewport.height*0.4167, ALLEGRO_ALIGN_CENTRE, t);
+		bool composited = BeginComposition(game);
+		if (composited) {
+			DrawComposited(game, data, t, fade);
+		} else if (HasQuality(game, QUALITY_INTRO_ZOOM)) {
+			al_set_target_bitmap(data->bitmap);
+			al_clear_to_color(al_map_rgba(0,0,0,0));
 
-		double tg = tan(-data->tan/384.0 * ALLEGRO_PI - ALLEGRO_PI/2);
+			al_draw_text(data->font, al_map_rgba(255,255,255,10), game->viewport.width/2,
+			             game->viewport.height*0.4167, ALLEGRO_ALIGN_CENTRE, t);
 
-		int fade = data->fadeout ? 255 : data->fade;
+			double tg = tan(-data->tan/384.0 * ALLEGRO_PI - ALLEGRO_PI/2);
+
+			al_set_target_bitmap(data->pixelator);
+			al_clear_to_color(al_map_rgb(35, 31, 32));
 
-		al_set_target_bitmap(data->pixelator);
-		al_clear_to_color(al_map_rgb(35, 31, 32));
+			al_draw_tinted_scaled_bitmap(data->bitmap, al_map_rgba(fade, fade, fade, fade), 0, 0,
+			                             al_get_bitmap_width(data->bitmap), al_get_bitmap_height(data->bitmap),
+			                             -tg*al_get_bitmap_width(data->bitmap)*0.05,
+			                             -tg*al_get_bitmap_height(data->bitmap)*0.05,
+			                             al_get_bitmap_width(data->bitmap)+tg*0.1*al_get_bitmap_width(data->bitmap),
+			                             al_get_bitmap_height(data->bitmap)+tg*0.1*al_get_bitmap_height(data->bitmap),
+			                             0);
+		} else {
+			// unzoomed, the text can go straight to the pixelator with the fade applied to its color
+			al_set_target_bitmap(data->pixelator);
+			al_clear_to_color(al_map_rgb(35, 31, 32));
 
-		al_draw_tinted_scaled_bitmap(data->bitmap, al_map_rgba(fade, fade, fade, fade), 0, 0,
-		                             al_get_bitmap_width(data->bitmap), al_get_bitmap_height(data->bitmap),
-		                             -tg*al_get_bitmap_width(data->bitmap)*0.05,
-		                             -tg*al_get_bitmap_height(data->bitmap)*0.05,
-		                             al_get_bitmap_width(data->bitmap)+tg*0.1*al_get_bitmap_width(data->bitmap),
-		                             al_get_bitmap_height(data->bitmap)+tg*0.1*al_get_bitmap_height(data->bitmap),
-		                             0);
+			al_draw_text(data->font, al_map_rgba(fade, fade, fade, 10*fade/255), game->viewport.width/2,
+			             game->viewport.height*0.4167, ALLEGRO_ALIGN_CENTRE, t);
+		}
 
-		al_draw_bitmap(data->checkerboard, 0, 0, 0);
+		if (!composited) {
+			if (HasQuality(game, QUALITY_CHECKERBOARD)) {
+				al_draw_bitmap(data->checkerboard, 0, 0, 0);
+			}
 
-		al_set_target_backbuffer(game->display);
+			al_set_target_backbuffer(game->display);
 
-		al_draw_bitmap(data->pixelator, 0, 0, 0);
+			al_draw_bitmap(data->pixelator, 0, 0, 0);
+		}
 
 	}
+	EndGovernedFrame(game);
+	TraceFrameDrawn("dosowisko");
+	CaptureFrame(game);
+	EndAllocPhase();
 }
 
 void Gamestate_Start(struct Game *game, struct GamestateResources* data) {
@@ -154,33 +213,36 @@ void Gamestate_Start(struct Game *game, struct GamestateResources* data) {
 	data->fadeout = false;
 	data->underscore=true;
 	strcpy(data->text, "#");
-	TM_AddDelay(data->timeline, 300);
-	TM_AddQueuedBackgroundAction(data->timeline, FadeIn, TM_AddToArgs(NULL, 1, data), 0, "fadein");
-	TM_AddDelay(data->timeline, 1500);
-	TM_AddAction(data->timeline, Play, TM_AddToArgs(NULL, 1, data->kbd), "playkbd");
-	TM_AddQueuedBackgroundAction(data->timeline, Type, TM_AddToArgs(NULL, 1, data), 0, "type");
-	TM_AddDelay(data->timeline, 3200);
-	TM_AddAction(data->timeline, Play, TM_AddToArgs(NULL, 1, data->key), "playkey");
-	TM_AddDelay(data->timeline, 50);
-	TM_AddAction(data->timeline, FadeOut, TM_AddToArgs(NULL, 1, data), "fadeout");
-	TM_AddDelay(data->timeline, 1000);
-	TM_AddAction(data->timeline, End, NULL, "end");
+	ScheduleDelay(data->schedule, 300);
+	ScheduleQueuedBackground(data->schedule, FadeIn, 0, "fadein", 1, data);
+	ScheduleDelay(data->schedule, 1500);
+	ScheduleAction(data->schedule, Play, "playkbd", 1, data->kbd);
+	ScheduleQueuedBackground(data->schedule, Type, 0, "type", 1, data);
+	ScheduleDelay(data->schedule, 3200);
+	ScheduleAction(data->schedule, Play, "playkey", 1, data->key);
+	ScheduleDelay(data->schedule, 50);
+	ScheduleAction(data->schedule, FadeOut, "fadeout", 1, data);
+	ScheduleDelay(data->schedule, 1000);
+	ScheduleAction(data->schedule, End, "end", 0);
 	al_play_sample_instance(data->sound);
 }
 
 void Gamestate_ProcessEvent(struct Game *game, struct GamestateResources* data, ALLEGRO_EVENT *ev) {
-	TM_HandleEvent(data->timeline, ev);
+	BeginAllocPhase(ALLOC_PHASE_EVENT);
 	if ((ev->type==ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_ESCAPE)) {
 		SwitchCurrentGamestate(game, "menu");
 	}
+	EndAllocPhase();
 }
 
 void* Gamestate_Load(struct Game *game, void (*progress)(struct Game*)) {
+	TraceBegin("dosowisko: Gamestate_Load");
+	HoldGameData(game);
 	struct GamestateResources *data = malloc(sizeof(struct GamestateResources));
-	data->timeline = TM_Init(game, "main");
-	data->bitmap = al_create_bitmap(game->viewport.width, game->viewport.height);
-	data->checkerboard = al_create_bitmap(game->viewport.width, game->viewport.height);
-	data->pixelator = al_create_bitmap(game->viewport.width, game->viewport.height);
+	data->schedule = CreateSchedule(game, "dosowisko");
+	data->bitmap = CreateBitmapAsset(game, "dosowisko", "bitmap", game->viewport.width, game->viewport.height);
+	data->checkerboard = CreateBitmapAsset(game, "dosowisko", "checkerboard", game->viewport.width, game->viewport.height);
+	data->pixelator = CreateBitmapAsset(game, "dosowisko", "pixelator", game->viewport.width, game->viewport.height);
 
 	al_set_target_bitmap(data->checkerboard);
 	al_lock_bitmap(data->checkerboard, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_WRITEONLY);
@@ -196,28 +258,37 @@ void* Gamestate_Load(struct Game *game, void (*progress)(struct Game*)) {
 	al_unlock_bitmap(data->checkerboard);
 	al_set_target_backbuffer(game->display);
 	(*progress)(game);
+	TraceInstant("dosowisko: progress");
 
-	data->font = al_load_ttf_font(GetDataFilePath(game, "fonts/DejaVuSansMono.ttf"),
-	                              (int)(game->viewport.height*0.1666 / 8) * 8 ,0 );
+	data->font = LoadFontAsset(game, "dosowisko", "fonts/DejaVuSansMono.ttf",
+	                           (int)(game->viewport.height*0.1666 / 8) * 8);
 	(*progress)(game);
-	data->sample = al_load_sample( GetDataFilePath(game, "dosowisko.flac") );
-	data->sound = al_create_sample_instance(data->sample);
+	TraceInstant("dosowisko: progress");
+	data->sample = LoadSampleAsset(game, "dosowisko", "dosowisko.flac");
+	data->sound = CreateSampleInstanceAsset(game, "dosowisko", "sound", data->sample);
 	al_attach_sample_instance_to_mixer(data->sound, game->audio.music);
 	al_set_sample_instance_playmode(data->sound, ALLEGRO_PLAYMODE_ONCE);
 	(*progress)(game);
+	TraceInstant("dosowisko: progress");
 
-	data->kbd_sample = al_load_sample( GetDataFilePath(game, "kbd.flac") );
-	data->kbd = al_create_sample_instance(data->kbd_sample);
+	data->kbd_sample = LoadSampleAsset(game, "dosowisko", "kbd.flac");
+	data->kbd = CreateSampleInstanceAsset(game, "dosowisko", "kbd", data->kbd_sample);
 	al_attach_sample_instance_to_mixer(data->kbd, game->audio.fx);
 	al_set_sample_instance_playmode(data->kbd, ALLEGRO_PLAYMODE_ONCE);
 	(*progress)(game);
+	TraceInstant("dosowisko: progress");
 
-	data->key_sample = al_load_sample( GetDataFilePath(game, "key.flac") );
-	data->key = al_create_sample_instance(data->key_sample);
+	data->key_sample = LoadSampleAsset(game, "dosowisko", "key.flac");
+	data->key = CreateSampleInstanceAsset(game, "dosowisko", "key", data->key_sample);
 	al_attach_sample_instance_to_mixer(data->key, game->audio.fx);
 	al_set_sample_instance_playmode(data->key, ALLEGRO_PLAYMODE_ONCE);
 	(*progress)(game);
+	TraceInstant("dosowisko: progress");
 
+	if (game->config.debug) DumpAssets(game, "dosowisko");
+	CheckAssetBudget(game, "dosowisko");
+
+	TraceEnd("dosowisko: Gamestate_Load");
 	return data;
 }
 
@@ -228,25 +299,29 @@ void Gamestate_Stop(struct Game *game, struct GamestateResources* data) {
 }
 
 void Gamestate_Unload(struct Game *game, struct GamestateResources* data) {
-	al_destroy_font(data->font);
+	// the font and samples stay in the asset cache
 	al_destroy_sample_instance(data->sound);
-	al_destroy_sample(data->sample);
 	al_destroy_sample_instance(data->kbd);
-	al_destroy_sample(data->kbd_sample);
 	al_destroy_sample_instance(data->key);
-	al_destroy_sample(data->key_sample);
 	al_destroy_bitmap(data->bitmap);
 	al_destroy_bitmap(data->checkerboard);
 	al_destroy_bitmap(data->pixelator);
-	TM_Destroy(data->timeline);
+	UntrackAssets(game, "dosowisko");
+	DestroySchedule(data->schedule);
 	free(data);
+	ReleaseGameData(game);
 }
 
-void Gamestate_Reload(struct Game *game, struct GamestateResources* data) {}
+void Gamestate_Reload(struct Game *game, struct GamestateResources* data) {
+	void **slots[] = {
+		(void**)&data->font, (void**)&data->sample, (void**)&data->kbd_sample, (void**)&data->key_sample
+	};
+	ReloadAssets(game, "dosowisko", slots, sizeof(slots)/sizeof(slots[0]));
+}
 
 void Gamestate_Pause(struct Game *game, struct GamestateResources* data) {
-	TM_Pause(data->timeline);
+	PauseSchedule(data->schedule);
 }
 void Gamestate_Resume(struct Game *game, struct GamestateResources* data) {
-	TM_Resume(data->timeline);
+	ResumeSchedule(data->schedule);
 }
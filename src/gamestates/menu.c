@@ -24,6 +24,10 @@
 #include <libsuperderpy.h>
 
 #define SOLO_MIN 20
+#define SPAWN_DIVISION 4 /*!< Grid steps per beat enemies spawn on. */
+#define CHORD_LEAD 20000 /*!< Samples the chord bank switches ahead of the beat. */
+#define BADGUY_RESERVE 12 /*!< Badguys created up front per lane, more than are ever alive at once. */
+#define BLAST_PARTICLES 20000 /*!< Sparks filling the screen when a solo ends. */
 
 int Gamestate_ProgressCount = 5;
 
@@ -74,14 +78,29 @@ struct MenuResources {
 				struct Badguy *next, *prev;
 				float speed;
 				bool melting;
-		} *badguys[4], *destroyQueue;
+		} **badguys, *destroyQueue; /*!< Dead badguys, brought back by later spawns. */
+		struct LaneLayout layout; /*!< Where the lanes above are, from lanes.ini. */
 
 		int timeTillNextBadguy, badguyRate;
+		bool spawnPending; /*!< Spawn timer ran out, waiting for the next step of the beat grid. */
+		int spawnStep;
+
+		struct BeatMap music_beats, solo_beats;
+
+		struct Random rng; /*!< Gameplay randomness, kept in snapshots. */
+		struct SnapshotRing snapshots; /*!< Gameplay state of recent ticks. */
+		uint32_t tick;
+		bool rewinding; /*!< Stepping back through snapshots instead of playing, debug mode only. */
+
+		struct ParticlePool *particles; /*!< Melt drips, chord sparks and solo blasts. */
+
+		struct SpectrumAnalyzer *music_spectrum, *fx_spectrum;
+		float bass, treble; /*!< Decaying levels of what's playing, pulsing the speaker and lights. */
 
 		struct Character *ego;
 		struct Character *cow;
 		struct Character *badguy;
-		struct Timeline *timeline;
+		struct Schedule *schedule;
 		float cloud_position; /*!< Position of bigger cloud. */
 		ALLEGRO_SAMPLE *sample; /*!< Music sample. */
 		ALLEGRO_SAMPLE *click_sample; /*!< Click sound sample. */
@@ -105,14 +124,7 @@ struct MenuResources {
 				int resolution;
 		} options; /*!< Options which can be changed in menu. */
 
-		struct {
-				int key;
-				bool shift;
-				int delay;
-				// workaround for random bogus UP/DOWN events
-				int lastkey;
-				int lastdelay;
-		} keys;
+		struct InputState input; /*!< Marker movement keys. */
 
 		int score;
 };
@@ -155,28 +167,28 @@ void About(struct Game *game, struct MenuResources* data) {
 
 void DrawMenuState(struct Game *game, struct MenuResources *data) {
 	ALLEGRO_FONT *font = data->font;
-	char* text = malloc(255*sizeof(char));
+	char text[255];
 	struct ALLEGRO_COLOR color;
 	switch (data->menustate) {
 		case MENUSTATE_MAIN:
-			DrawTextWithShadow(font, data->selected==0 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.5, ALLEGRO_ALIGN_CENTRE, "Start game");
-			DrawTextWithShadow(font, data->selected==1 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.6, ALLEGRO_ALIGN_CENTRE, "Options");
-			DrawTextWithShadow(font, data->selected==2 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.7, ALLEGRO_ALIGN_CENTRE, "About");
-			DrawTextWithShadow(font, data->selected==3 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.8, ALLEGRO_ALIGN_CENTRE, "Exit");
+			DrawShadowedText(game, font, data->selected==0 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.5, ALLEGRO_ALIGN_CENTRE, "Start game");
+			DrawShadowedText(game, font, data->selected==1 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.6, ALLEGRO_ALIGN_CENTRE, "Options");
+			DrawShadowedText(game, font, data->selected==2 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.7, ALLEGRO_ALIGN_CENTRE, "About");
+			DrawShadowedText(game, font, data->selected==3 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.8, ALLEGRO_ALIGN_CENTRE, "Exit");
 			break;
 		case MENUSTATE_OPTIONS:
-			DrawTextWithShadow(font, data->selected==0 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.5, ALLEGRO_ALIGN_CENTRE, "Video settings");
-			DrawTextWithShadow(font, data->selected==1 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.6, ALLEGRO_ALIGN_CENTRE, "Audio settings");
-			DrawTextWithShadow(font, data->selected==3 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.8, ALLEGRO_ALIGN_CENTRE, "Back");
+			DrawShadowedText(game, font, data->selected==0 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.5, ALLEGRO_ALIGN_CENTRE, "Video settings");
+			DrawShadowedText(game, font, data->selected==1 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.6, ALLEGRO_ALIGN_CENTRE, "Audio settings");
+			DrawShadowedText(game, font, data->selected==3 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.8, ALLEGRO_ALIGN_CENTRE, "Back");
 			break;
 		case MENUSTATE_AUDIO:
 			if (game->config.music) snprintf(text, 255, "Music volume: %d0%%", game->config.music);
 			else sprintf(text, "Music disabled");
-			DrawTextWithShadow(font, data->selected==0 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.5, ALLEGRO_ALIGN_CENTRE, text);
+			DrawShadowedText(game, font, data->selected==0 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.5, ALLEGRO_ALIGN_CENTRE, text);
 			if (game->config.fx) snprintf(text, 255, "Effects volume: %d0%%", game->config.fx);
 			else sprintf(text, "Effects disabled");
-			DrawTextWithShadow(font, data->selected==1 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.6, ALLEGRO_ALIGN_CENTRE, text);
-			DrawTextWithShadow(font, data->selected==3 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.8, ALLEGRO_ALIGN_CENTRE, "Back");
+			DrawShadowedText(game, font, data->selected==1 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.6, ALLEGRO_ALIGN_CENTRE, text);
+			DrawShadowedText(game, font, data->selected==3 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.8, ALLEGRO_ALIGN_CENTRE, "Back");
 			break;
 		case MENUSTATE_ABOUT:
 			About(game, data);
@@ -190,36 +202,35 @@ void DrawMenuState(struct Game *game, struct MenuResources *data) {
 				sprintf(text, "Fullscreen: no");
 				color = data->selected==1 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255);
 			}
-			DrawTextWithShadow(font, data->selected==0 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.5, ALLEGRO_ALIGN_CENTRE, text);
+			DrawShadowedText(game, font, data->selected==0 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.5, ALLEGRO_ALIGN_CENTRE, text);
 			sprintf(text, "Resolution: %dx", data->options.resolution);
-			DrawTextWithShadow(font, color, game->viewport.width*0.5, game->viewport.height*0.6, ALLEGRO_ALIGN_CENTRE, text);
-			DrawTextWithShadow(font, data->selected==3 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.8, ALLEGRO_ALIGN_CENTRE, "Back");
+			DrawShadowedText(game, font, color, game->viewport.width*0.5, game->viewport.height*0.6, ALLEGRO_ALIGN_CENTRE, text);
+			DrawShadowedText(game, font, data->selected==3 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.8, ALLEGRO_ALIGN_CENTRE, "Back");
 			break;
 		case MENUSTATE_HIDDEN:
 			break;
 		case MENUSTATE_LOST:
-			DrawTextWithShadow(font, al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.5, ALLEGRO_ALIGN_CENTRE, "You lost!");
+			DrawShadowedText(game, font, al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.5, ALLEGRO_ALIGN_CENTRE, "You lost!");
 			sprintf(text, "Score: %d", data->score);
-			DrawTextWithShadow(font, al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.6, ALLEGRO_ALIGN_CENTRE, text);
-			DrawTextWithShadow(font, al_map_rgb(255,255,128), game->viewport.width*0.5, game->viewport.height*0.8, ALLEGRO_ALIGN_CENTRE, "Back to menu");
+			DrawShadowedText(game, font, al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.6, ALLEGRO_ALIGN_CENTRE, text);
+			DrawShadowedText(game, font, al_map_rgb(255,255,128), game->viewport.width*0.5, game->viewport.height*0.8, ALLEGRO_ALIGN_CENTRE, "Back to menu");
 			break;
 		case MENUSTATE_INTRO:
-			DrawTextWithShadow(font, al_map_rgba(0,0,0,64), 46, game->viewport.height*0.5, ALLEGRO_ALIGN_CENTRE, "Evi");
-			DrawTextWithShadow(font, al_map_rgba(0,0,0,64), 51, game->viewport.height*0.5-1, ALLEGRO_ALIGN_CENTRE, "vi");
-			DrawTextWithShadow(font, al_map_rgb(255,255,128), game->viewport.width*0.5, game->viewport.height*0.5, ALLEGRO_ALIGN_CENTRE, "Evil record label representatives want");
-			DrawTextWithShadow(font, al_map_rgba(0,0,0,64), 47, game->viewport.height*0.55, ALLEGRO_ALIGN_CENTRE, "tu");
-			DrawTextWithShadow(font, al_map_rgba(0,0,0,64), 48, game->viewport.height*0.55 - 1, ALLEGRO_ALIGN_CENTRE, "tu");
-			DrawTextWithShadow(font, al_map_rgb(255,255,128), game->viewport.width*0.5, game->viewport.height*0.55, ALLEGRO_ALIGN_CENTRE, "to turn your awesome single into radio edit.");
-			DrawTextWithShadow(font, al_map_rgb(255,255,128), game->viewport.width*0.5, game->viewport.height*0.6, ALLEGRO_ALIGN_CENTRE, "Thankfully, with your facemelting guitar");
-			DrawTextWithShadow(font, al_map_rgb(255,255,128), game->viewport.width*0.5, game->viewport.height*0.65, ALLEGRO_ALIGN_CENTRE, "skills you don't have to give up so easily!");
-			DrawTextWithShadow(font, al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.8, ALLEGRO_ALIGN_CENTRE, "Press ENTER to continue...");
+			DrawShadowedText(game, font, al_map_rgba(0,0,0,64), 46, game->viewport.height*0.5, ALLEGRO_ALIGN_CENTRE, "Evi");
+			DrawShadowedText(game, font, al_map_rgba(0,0,0,64), 51, game->viewport.height*0.5-1, ALLEGRO_ALIGN_CENTRE, "vi");
+			DrawShadowedText(game, font, al_map_rgb(255,255,128), game->viewport.width*0.5, game->viewport.height*0.5, ALLEGRO_ALIGN_CENTRE, "Evil record label representatives want");
+			DrawShadowedText(game, font, al_map_rgba(0,0,0,64), 47, game->viewport.height*0.55, ALLEGRO_ALIGN_CENTRE, "tu");
+			DrawShadowedText(game, font, al_map_rgba(0,0,0,64), 48, game->viewport.height*0.55 - 1, ALLEGRO_ALIGN_CENTRE, "tu");
+			DrawShadowedText(game, font, al_map_rgb(255,255,128), game->viewport.width*0.5, game->viewport.height*0.55, ALLEGRO_ALIGN_CENTRE, "to turn your awesome single into radio edit.");
+			DrawShadowedText(game, font, al_map_rgb(255,255,128), game->viewport.width*0.5, game->viewport.height*0.6, ALLEGRO_ALIGN_CENTRE, "Thankfully, with your facemelting guitar");
+			DrawShadowedText(game, font, al_map_rgb(255,255,128), game->viewport.width*0.5, game->viewport.height*0.65, ALLEGRO_ALIGN_CENTRE, "skills you don't have to give up so easily!");
+			DrawShadowedText(game, font, al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.8, ALLEGRO_ALIGN_CENTRE, "Press ENTER to continue...");
 			break;
 		default:
 			data->selected=0;
-			DrawTextWithShadow(font, data->selected==0 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.5, ALLEGRO_ALIGN_CENTRE, "Not implemented yet");
+			DrawShadowedText(game, font, data->selected==0 ? al_map_rgb(255,255,128) : al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.5, ALLEGRO_ALIGN_CENTRE, "Not implemented yet");
 			break;
 	}
-	free(text);
 }
 
 void AnimateBadguys(struct Game *game, struct MenuResources *data, int i) {
@@ -263,25 +274,26 @@ void MoveBadguys(struct Game *game, struct MenuResources *data, int i, float dx)
 void ChangeMenuState(struct Game *game, struct MenuResources* data, enum menustate_enum state) {
 	data->menustate=state;
 	data->selected=0;
-	PrintConsole(game, "menu state changed %d", state);
+	LogEvent(LOG_MENU_STATE, state);
 }
 
 void CheckForEnd(struct Game *game, struct MenuResources *data) {
-	int i;
-	bool lost = false;
-	for (i=0; i<4; i++) {
-		struct Badguy *tmp = data->badguys[i];
+	int i, lane = -1;
+	struct Badguy *tmp = NULL;
+	for (i=0; (i<data->layout.count) && (lane < 0); i++) {
+		tmp = data->badguys[i];
 		while (tmp) {
-			if (GetCharacterX(game, tmp->character) <= ((139-(i*10))-10)) {
-				lost = true;
+			if (GetCharacterX(game, tmp->character) <= data->layout.lanes[i].end) {
+				lane = i;
 				break;
 			}
 			tmp=tmp->next;
 		}
-		if (lost) break;
 	}
 
-	if (lost) {
+	if (lane >= 0) {
+		// only the first badguy to get through is recorded, the game ends right here
+		RecordTelemetry(game, TELEMETRY_LOSS, data->tick, lane, data->score, GetCharacterX(game, tmp->character), tmp->speed * data->badguySpeed * 1000);
 
 		al_stop_sample_instance(data->solo);
 		data->soloactive=false;
@@ -299,95 +311,147 @@ void CheckForEnd(struct Game *game, struct MenuResources *data) {
 void DrawBadguys(struct Game *game, struct MenuResources *data, int i) {
 	struct Badguy *tmp = data->badguys[i];
 	while (tmp) {
-		DrawCharacter(game, tmp->character, al_map_rgb(255,255,255), 0);
+		DrawCharacterFrame(game, tmp->character, al_map_rgb(255,255,255), 0);
 		tmp=tmp->next;
 	}
 }
 
-void Gamestate_Draw(struct Game *game, struct MenuResources* data) {
-
-	al_set_target_bitmap(al_get_backbuffer(game->display));
-
-	al_clear_to_color(al_map_rgb(3, 213, 255));
+static void DrawScene(struct Game *game, struct MenuResources* data) {
+	bool composited = BeginComposition(game);
+	ALLEGRO_COLOR sky = data->soloflash ? al_map_rgb(255, 255, 255) : al_map_rgb(3, 213, 255);
+	if (composited) {
+		CompositeClear(game, sky);
+	} else {
+		al_clear_to_color(sky);
+	}
 
-	al_draw_bitmap(data->bg,0, 0,0);
+	DrawPaletteBitmap(game, data->bg, al_map_rgb(255,255,255), 0, 0,0);
 
-	al_draw_bitmap(data->cloud,(int)(game->viewport.width*data->cloud_position/100), 10 ,0);
+	if (HasQuality(game, QUALITY_CLOUD)) {
+		DrawPaletteBitmap(game, data->cloud, al_map_rgb(255,255,255), (int)(game->viewport.width*data->cloud_position/100), 10 ,0);
+	}
 
-	al_draw_bitmap(data->forest,0, 0,0);
+	DrawPaletteBitmap(game, data->forest, al_map_rgb(255,255,255), 0, 0,0);
 
-	al_draw_bitmap(data->grass,0, 0,0);
+	DrawPaletteBitmap(game, data->grass, al_map_rgb(255,255,255), 0, 0,0);
 
-	DrawCharacter(game, data->cow, al_map_rgb(255,255,255), 0);
+	DrawCharacterFrame(game, data->cow, al_map_rgb(255,255,255), 0);
 
-	al_draw_bitmap(data->speaker,104, 19,0);
+	int pulse = (int)(data->bass * 2);
+	if (composited) {
+		CompositeBitmapRegion(game, data->speaker, al_map_rgb(255,255,255), 0, 0, al_get_bitmap_width(data->speaker), al_get_bitmap_height(data->speaker),
+		                      104 - pulse, 19 - pulse, al_get_bitmap_width(data->speaker) + pulse * 2, al_get_bitmap_height(data->speaker) + pulse * 2, 0);
+	} else {
+		UsePaletteShader(game, data->speaker);
+		al_draw_scaled_bitmap(data->speaker, 0, 0, al_get_bitmap_width(data->speaker), al_get_bitmap_height(data->speaker),
+		                      104 - pulse, 19 - pulse, al_get_bitmap_width(data->speaker) + pulse * 2, al_get_bitmap_height(data->speaker) + pulse * 2, 0);
+	}
 
-	al_draw_bitmap(data->stage,0, 0,0);
+	DrawPaletteBitmap(game, data->stage, al_map_rgb(255,255,255), 0, 0,0);
 
-	al_draw_bitmap(data->lines, 100, 136,0);
+	DrawPaletteBitmap(game, data->lines, al_map_rgb(255,255,255), 100, 136,0);
 
-	al_draw_bitmap(data->cable,0,151,0);
+	DrawPaletteBitmap(game, data->cable, al_map_rgb(255,255,255), 0,151,0);
 
-	DrawCharacter(game, data->ego, al_map_rgb(255,255,255), 0);
+	DrawCharacterFrame(game, data->ego, al_map_rgb(255,255,255), 0);
 
 	if (data->menustate == MENUSTATE_HIDDEN) {
 
 		if (!data->soloactive) {
-			if (data->marky == 0) {
-				al_draw_bitmap(data->marksmall, data->markx, 128, 0);
-			} else if (data->marky == 1) {
-				al_draw_bitmap(data->marksmall, data->markx, 140, 0);
-			} else if (data->marky == 2) {
-				al_draw_bitmap(data->markbig, data->markx, 152, 0);
-			} else if (data->marky == 3) {
-				al_draw_bitmap(data->markbig, data->markx, 166, 0);
-			}
+			struct Lane *lane = &data->layout.lanes[data->marky];
+			DrawPaletteBitmap(game, lane->big ? data->markbig : data->marksmall, al_map_rgb(255,255,255), data->markx, lane->marker, 0);
 		}
 
-		if (data->lightanim) {
-			int offset = -5;
-			if (data->lighty == 1) offset = -3;
-			if (data->lighty == 2) offset = 0;
-			if (data->lighty == 3) offset = 4;
-			al_draw_tinted_bitmap(data->light, al_map_rgba(255, 255, 255,rand() % 256 / 50 * 50) , data->lightx - 171 - (data->lighty < 2 ? 1 : 0), 109+(data->lighty*10) - 143 + offset, 0);
+		if (data->lightanim && HasQuality(game, QUALITY_LIGHT_FLICKER)) {
+			struct Lane *lane = &data->layout.lanes[data->lighty];
+			DrawPaletteBitmap(game, data->light, al_map_rgba(255, 255, 255, (int)(data->treble * 255) / 50 * 50) , data->lightx + lane->light_x, lane->light_y, 0);
 		}
 
 	}
 
-	DrawBadguys(game, data, 0);
-	DrawBadguys(game, data, 1);
-	DrawBadguys(game, data, 2);
-	DrawBadguys(game, data, 3);
+	int i;
+	for (i=0; i<data->layout.count; i++) {
+		DrawBadguys(game, data, i);
+	}
+	FinishPaletteDrawing(game);
+
+	DrawParticles(game, data->particles);
+
+	// text isn't composited, so it goes on top of the uploaded frame
+	if (composited) PresentComposition(game);
 
 	if (data->menustate != MENUSTATE_HIDDEN) {
-		DrawTextWithShadow(data->font_title, al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.15, ALLEGRO_ALIGN_CENTRE, data->menustate == MENUSTATE_LOST ? "Radio Edited!" : "Radio Edit");
+		DrawShadowedText(game, data->font_title, al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.15, ALLEGRO_ALIGN_CENTRE, data->menustate == MENUSTATE_LOST ? "Radio Edited!" : "Radio Edit");
 		DrawMenuState(game, data);
 	} else {
 		char score[255];
 		snprintf(score, 255, "Score: %d", data->score);
-		DrawTextWithShadow(data->font, al_map_rgb(255,255,255), 2, game->viewport.height - 10, ALLEGRO_ALIGN_LEFT, score);
+		DrawShadowedText(game, data->font, al_map_rgb(255,255,255), 2, game->viewport.height - 10, ALLEGRO_ALIGN_LEFT, score);
 
 		if ((data->soloready >= SOLO_MIN) && (data->soloanim <= 30)) {
-			DrawTextWithShadow(data->font, al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.15, ALLEGRO_ALIGN_CENTRE, "Press ENTER to play a solo!");
+			DrawShadowedText(game, data->font, al_map_rgb(255,255,255), game->viewport.width*0.5, game->viewport.height*0.15, ALLEGRO_ALIGN_CENTRE, "Press ENTER to play a solo!");
 		}
 	}
 
-	if (data->soloflash) {
+}
+
+void Gamestate_Draw(struct Game *game, struct MenuResources* data) {
+	BeginAllocPhase(ALLOC_PHASE_DRAW);
+	TraceFramePresented("menu", true);
+	InputFramePresented(&data->input);
+	BeginGovernedFrame(game);
+
+	al_set_target_bitmap(al_get_backbuffer(game->display));
+
+	// the flash is a palette swap, unless bitmaps don't go through the palette shader
+	bool swapped = data->soloflash && SetPaletteFlash(game, true);
+	DrawScene(game, data);
+	if (swapped) {
+		SetPaletteFlash(game, false);
+	} else if (data->soloflash) {
 		al_draw_filled_rectangle(0, 0, 320, 180, al_map_rgb(255,255,255));
 	}
+
+	EndGovernedFrame(game);
+	if ((data->menustate == MENUSTATE_HIDDEN) && !data->rewinding) {
+		RecordTelemetryFrame(game, data->tick);
+	}
+	InputFrameDrawn(&data->input);
+	TraceFrameDrawn("menu");
+	CaptureFrame(game);
+	EndAllocPhase();
 }
 
-void AddBadguy(struct Game *game, struct MenuResources* data, int i) {
-	struct Badguy *n = malloc(sizeof(struct Badguy));
+/*! \brief Adds dead badguys for later spawns to bring back, so they don't have to be allocated while playing. */
+static void ReserveBadguys(struct Game *game, struct MenuResources* data, int count) {
+	while (count--) {
+		struct Badguy *n = malloc(sizeof(struct Badguy));
+		n->character = CreateCharacterAsset(game, "badguy");
+		n->character->spritesheets = data->badguy->spritesheets;
+		n->character->shared = true;
+		n->character->dead = true;
+		n->prev = NULL;
+		n->next = data->destroyQueue;
+		if (data->destroyQueue) data->destroyQueue->prev = n;
+		data->destroyQueue = n;
+	}
+}
+
+static struct Badguy* CreateBadguy(struct Game *game, struct MenuResources* data, int i, float speed) {
+	if (!data->destroyQueue) {
+		ReserveBadguys(game, data, 1);
+	}
+	struct Badguy *n = data->destroyQueue;
+	data->destroyQueue = n->next;
+	if (n->next) n->next->prev = NULL;
 	n->next = NULL;
 	n->prev = NULL;
-	n->speed = (rand() % 3) * 0.25 + 1;
+	n->speed = speed;
 	n->melting = false;
-	n->character = CreateCharacter(game, "badguy");
-	n->character->spritesheets = data->badguy->spritesheets;
-	n->character->shared = true;
+	n->character->dead = false;
 	SelectSpritesheet(game, n->character, "walk");
-	SetCharacterPosition(game, n->character, 320, 108+(i*13), 0);
+	n->character->pos_tmp = 0;
+	SetCharacterPosition(game, n->character, 320, data->layout.lanes[i].y, 0);
 
 	if (data->badguys[i]) {
 		struct Badguy *tmp = data->badguys[i];
@@ -399,6 +463,16 @@ void AddBadguy(struct Game *game, struct MenuResources* data, int i) {
 	} else {
 		data->badguys[i] = n;
 	}
+	return n;
+}
+
+void AddBadguy(struct Game *game, struct MenuResources* data, int i) {
+	CreateBadguy(game, data, i, RandomInt(&data->rng, 3) * 0.25 + 1);
+}
+
+static void EmitMelt(struct Game *game, struct MenuResources *data, int lane, struct Badguy *badguy) {
+	EmitParticles(data->particles, 40, GetCharacterX(game, badguy->character), data->layout.lanes[lane].y + 2, 10, 10,
+	              0.6, -ALLEGRO_PI / 2, ALLEGRO_PI, al_map_rgb(255, 128, 64), 40);
 }
 
 void Fire(struct Game *game, struct MenuResources *data) {
@@ -410,98 +484,135 @@ void Fire(struct Game *game, struct MenuResources *data) {
 	data->lightanim=1;
 	data->usage=30;
 
-	int num = rand() % 3;
-	if (((al_get_sample_instance_position(data->music) + 20000) / 44118) % 2 == 1) {
+	int num = RandomInt(&data->rng, 3);
+	if (GetBeat(&data->music_beats, al_get_sample_instance_position(data->music) + CHORD_LEAD) % 2 == 1) {
 		num += 3;
 	}
 	al_stop_sample_instance(data->chords[num]);
 	al_play_sample_instance(data->chords[num]);
-	PrintConsole(game, "playing chord nr %d", num);
+	LogEvent(LOG_CHORD, num);
+	EmitParticles(data->particles, 24, data->markx, data->layout.lanes[data->marky].marker, 8, 2,
+	              1.5, -ALLEGRO_PI / 2, ALLEGRO_PI / 2, al_map_rgb(255, 255, 128), 24);
 
+	bool hit = false;
 	struct Badguy *tmp = data->badguys[data->marky];
 	while (tmp) {
 		if (!tmp->melting) {
 			if ((data->markx >= GetCharacterX(game, tmp->character) - 9) && (data->markx <= GetCharacterX(game, tmp->character) + 1)) {
-				data->score += 100 * tmp->speed;
+				int points = 100 * tmp->speed;
+				data->score += points;
 				SelectSpritesheet(game, tmp->character, "melt");
 				data->soloready++;
 				tmp->melting = true;
+				EmitMelt(game, data, data->marky, tmp);
+				RecordTelemetry(game, TELEMETRY_HIT, data->tick, data->marky, points, data->markx, 0);
+				hit = true;
 			}
 		}
 		tmp=tmp->next;
 	}
+	if (!hit) {
+		RecordTelemetry(game, TELEMETRY_MISS, data->tick, data->marky, 0, data->markx, 0);
+	}
 }
 
-void Gamestate_Logic(struct Game *game, struct MenuResources* data) {
+void Gamestate_Reload(struct Game *game, struct MenuResources* data);
+static void TakeSnapshot(struct Game *game, struct MenuResources* data);
+static void RewindSnapshot(struct Game *game, struct MenuResources* data);
+static void ProcessEvent(struct Game *game, struct MenuResources* data, ALLEGRO_EVENT *ev);
+
+static void UpdatePulse(struct MenuResources* data) {
+	float music[SPECTRUM_BANDS], fx[SPECTRUM_BANDS];
+	ReadSpectrum(data->music_spectrum, music);
+	ReadSpectrum(data->fx_spectrum, fx);
+	float bass = fmax(fmax(music[0], music[1]), fmax(fx[0], fx[1]));
+	float treble = fmax(fmax(music[5], music[6]), fmax(fx[5], fx[6]));
+	data->bass = fmax(bass, data->bass * 0.85);
+	data->treble = fmax(treble, data->treble * 0.85);
+}
+
+static void Logic(struct Game *game, struct MenuResources* data) {
+	TraceFramePresented("menu", true);
+	InputFramePresented(&data->input);
 
-	if (data->keys.lastkey == data->keys.key) {
-		data->keys.delay = data->keys.lastdelay; // workaround for random bugus UP/DOWN events
+	if (PollAssetChanges(game, "menu")) {
+		Gamestate_Reload(game, data);
+	}
+
+	UpdatePulse(data);
+	SetAllocSteadyState((data->menustate == MENUSTATE_HIDDEN) && !data->rewinding);
+	if (UpdateLatencyProbe(game, (data->menustate == MENUSTATE_HIDDEN) && !data->rewinding)) {
+		UnloadGamestate(game, "menu");
+		return;
+	}
+	ALLEGRO_EVENT press;
+	while (PollLatencyEvent(game, &press)) {
+		ProcessEvent(game, data, &press);
+	}
+
+	if (data->rewinding && (data->menustate == MENUSTATE_HIDDEN)) {
+		RewindSnapshot(game, data);
+		return;
 	}
 
 	data->cloud_position-=0.1;
-	if (data->cloud_position<-40) { data->cloud_position=100; PrintConsole(game, "cloud_position"); }
+	if (data->cloud_position<-40) { data->cloud_position=100; LogEvent(LOG_CLOUD_WRAP); }
 	AnimateCharacter(game, data->ego, 1);
 	AnimateCharacter(game, data->cow, 1);
+	UpdateParticles(data->particles);
 
 	if (data->menustate == MENUSTATE_HIDDEN) {
 
-		if ((data->keys.key) && (data->keys.delay < 3)) {
+		int key = PollInput(&data->input);
+		if (key) {
 
-			if (data->keys.key==ALLEGRO_KEY_UP) {
+			if (key==ALLEGRO_KEY_UP) {
 				data->marky--;
-				int min = 139-(data->marky*10);
+				// the marker keeps its place along the lanes, which are skewed
+				int min = data->marky < 0 ? data->layout.lanes[0].min + 10 : data->layout.lanes[data->marky].min;
 				int step = 10 - (data->markx - min) / ((320-min)/10);
 				data->markx+= step;
 				if (data->marky < 0) {
-					data->markx-=4*step;
-					data->marky = 3;
+					data->markx-=data->layout.count*step;
+					data->marky = data->layout.count - 1;
 				}
 			}
 
-			if (data->keys.key==ALLEGRO_KEY_DOWN) {
+			if (key==ALLEGRO_KEY_DOWN) {
 				data->marky++;
-				int min = 139-(data->marky*10);
+				int min = data->marky >= data->layout.count ? data->layout.lanes[data->layout.count - 1].min - 10 : data->layout.lanes[data->marky].min;
 				int step = 10 - (data->markx - min) / ((320-min)/10);
 				data->markx-= step;
-				if (data->marky > 3) {
-					data->markx+=4*step;
+				if (data->marky >= data->layout.count) {
+					data->markx+=data->layout.count*step;
 					data->marky = 0;
 				}
 			}
 
-			if (data->keys.key==ALLEGRO_KEY_LEFT) {
-				int min = 139-(data->marky*10);
-				data->markx-= data->keys.shift ? 5 : 2;
+			if (key==ALLEGRO_KEY_LEFT) {
+				int min = data->layout.lanes[data->marky].min;
+				data->markx-= data->input.shift ? 5 : 2;
 				if (data->markx < min) data->markx=min;
 			}
 
-			if (data->keys.key==ALLEGRO_KEY_RIGHT) {
-				int max = 320 - al_get_bitmap_width(data->markbig);
-				if (data->marky < 2) max = 320 - al_get_bitmap_width(data->marksmall);
-				data->markx+= data->keys.shift ? 5 : 2;
+			if (key==ALLEGRO_KEY_RIGHT) {
+				int max = 320 - al_get_bitmap_width(data->layout.lanes[data->marky].big ? data->markbig : data->marksmall);
+				data->markx+= data->input.shift ? 5 : 2;
 				if (data->markx > max) data->markx=max;
 			}
 
-			if ((data->keys.key==ALLEGRO_KEY_SPACE) && (data->usage==0)) {
+			if ((key==ALLEGRO_KEY_SPACE) && (data->usage==0)) {
 				Fire(game, data);
 			}
-
-			if (data->keys.delay == INT_MIN) data->keys.delay = 45;
-			else data->keys.delay += 4;
-
-		} else if (data->keys.key) {
-			data->keys.delay-=3;
 		}
 
-		AnimateBadguys(game, data, 0);
-		AnimateBadguys(game, data, 1);
-		AnimateBadguys(game, data, 2);
-		AnimateBadguys(game, data, 3);
-
-		MoveBadguys(game, data, 0, -0.17);
-		MoveBadguys(game, data, 1, -0.18);
-		MoveBadguys(game, data, 2, -0.19);
-		MoveBadguys(game, data, 3, -0.2);
+		int i;
+		for (i=0; i<data->layout.count; i++) {
+			AnimateBadguys(game, data, i);
+		}
+		for (i=0; i<data->layout.count; i++) {
+			MoveBadguys(game, data, i, -data->layout.lanes[i].speed);
+		}
 
 		data->timeTillNextBadguy--;
 		if (data->timeTillNextBadguy <= 0) {
@@ -510,10 +621,18 @@ void Gamestate_Logic(struct Game *game, struct MenuResources* data) {
 			if (data->badguyRate < 20) {
 				data->badguyRate = 20;
 			}
+			data->spawnPending = true;
+		}
 
+		// spawns land on the beat grid of whatever is playing
+		int step = data->soloactive ? GetBeatStep(&data->solo_beats, al_get_sample_instance_position(data->solo), SPAWN_DIVISION)
+		                            : GetBeatStep(&data->music_beats, al_get_sample_instance_position(data->music), SPAWN_DIVISION);
+		if (data->spawnPending && (step != data->spawnStep)) {
+			data->spawnPending = false;
 			data->badguySpeed+= 0.001;
-			AddBadguy(game, data, rand() % 4);
+			AddBadguy(game, data, RandomInt(&data->rng, data->layout.count));
 		}
+		data->spawnStep = step;
 
 		if (data->usage) { data->usage--; }
 		if (data->lightanim) { data->lightanim++;}
@@ -527,42 +646,60 @@ void Gamestate_Logic(struct Game *game, struct MenuResources* data) {
 
 	if (data->soloactive) {
 		if (al_get_sample_instance_position(data->solo) >= 163840) {
-			PrintConsole(game, "BLAAAST");
+			LogEvent(LOG_SOLO_BLAST);
 			data->soloflash = 6;
 			data->soloactive=false;
 			data->badguySpeed+=0.5;
 			data->badguyRate += 20;
+			EmitParticles(data->particles, BLAST_PARTICLES, 0, 0, game->viewport.width, game->viewport.height,
+			              2, 0, 2 * ALLEGRO_PI, al_map_rgb(255, 255, 255), 45);
 
-			int i;
-			for (i=0; i<4; i++) {
+			int i, melted = 0, score = data->score;
+			for (i=0; i<data->layout.count; i++) {
 				struct Badguy *tmp = data->badguys[i];
 				while (tmp) {
 					if ((!tmp->melting) && (!tmp->character->dead)) {
 						data->score += 100 * tmp->speed;
 						SelectSpritesheet(game, tmp->character, "melt");
 						tmp->melting = true;
+						EmitMelt(game, data, i, tmp);
+						melted++;
 					}
 					tmp=tmp->next;
 				}
 			}
+			RecordTelemetry(game, TELEMETRY_BLAST, data->tick, 0, melted, data->score - score, 0);
 
 		}
 	}
 
 	if (data->soloflash) data->soloflash--;
 
-	data->keys.lastkey = data->keys.key;
-	data->keys.lastdelay = data->keys.delay;
+	if (data->menustate == MENUSTATE_HIDDEN) {
+		if (data->tick % TELEMETRY_SAMPLE_TICKS == 0) {
+			RecordTelemetry(game, TELEMETRY_SAMPLE, data->tick, 0, data->score, data->badguyRate, data->badguySpeed * 1000);
+		}
+		TakeSnapshot(game, data);
+	}
+
+	ProcessSchedule(data->schedule);
+}
 
-	TM_Process(data->timeline);
+void Gamestate_Logic(struct Game *game, struct MenuResources* data) {
+	BeginAllocPhase(ALLOC_PHASE_LOGIC);
+	Logic(game, data);
+	EndAllocPhase();
 }
 
 void* Gamestate_Load(struct Game *game, void (*progress)(struct Game*)) {
+	TraceBegin("menu: Gamestate_Load");
+	HoldGameData(game);
 
 	struct MenuResources *data = malloc(sizeof(struct MenuResources));
 
-	data->timeline = TM_Init(game, "main");
+	data->schedule = CreateSchedule(game, "menu");
 	(*progress)(game);
+	TraceInstant("menu: progress");
 
 	data->options.fullscreen = game->config.fullscreen;
 //	data->options.fps = game->config.fps;
@@ -571,41 +708,50 @@ void* Gamestate_Load(struct Game *game, void (*progress)(struct Game*)) {
 	data->options.resolution = game->config.width / 320;
 	if (game->config.height / 180 < data->options.resolution) data->options.resolution = game->config.height / 180;
 
-	data->bg = al_load_bitmap( GetDataFilePath(game, "bg.png") );
-	data->forest = al_load_bitmap( GetDataFilePath(game, "forest.png") );
-	data->grass = al_load_bitmap( GetDataFilePath(game, "grass.png") );
-	data->speaker = al_load_bitmap( GetDataFilePath(game, "speaker.png") );
-	data->stage = al_load_bitmap( GetDataFilePath(game, "stage.png") );
-	data->cloud = al_load_bitmap( GetDataFilePath(game, "cloud.png") );
-	data->lines = al_load_bitmap( GetDataFilePath(game, "lines.png") );
-	data->cable = al_load_bitmap( GetDataFilePath(game, "cable.png") );
-	data->marksmall = al_load_bitmap( GetDataFilePath(game, "mark-small.png") );
-	data->markbig = al_load_bitmap( GetDataFilePath(game, "mark-big.png") );
-	data->light = al_load_bitmap( GetDataFilePath(game, "light.png") );
-	data->sample = al_load_sample( GetDataFilePath(game, "menu.flac") );
-	data->click_sample = al_load_sample( GetDataFilePath(game, "click.flac") );
-	data->quit_sample = al_load_sample( GetDataFilePath(game, "quit.flac") );
-	data->end_sample = al_load_sample( GetDataFilePath(game, "end.flac") );
-	data->solo_sample = al_load_sample( GetDataFilePath(game, "solo.flac") );
+	InitInput(&data->input);
+	InitSnapshotRing(&data->snapshots);
+
+	data->bg = LoadBitmapAsset(game, "menu", "bg.png");
+	data->forest = LoadBitmapAsset(game, "menu", "forest.png");
+	data->grass = LoadBitmapAsset(game, "menu", "grass.png");
+	data->speaker = LoadBitmapAsset(game, "menu", "speaker.png");
+	data->stage = LoadBitmapAsset(game, "menu", "stage.png");
+	data->cloud = LoadBitmapAsset(game, "menu", "cloud.png");
+	data->lines = LoadBitmapAsset(game, "menu", "lines.png");
+	data->cable = LoadBitmapAsset(game, "menu", "cable.png");
+	data->marksmall = LoadBitmapAsset(game, "menu", "mark-small.png");
+	data->markbig = LoadBitmapAsset(game, "menu", "mark-big.png");
+	data->light = LoadBitmapAsset(game, "menu", "light.png");
+	data->sample = LoadSampleAsset(game, "menu", "menu.flac");
+	data->click_sample = LoadSampleAsset(game, "menu", "click.flac");
+	data->quit_sample = LoadSampleAsset(game, "menu", "quit.flac");
+	data->end_sample = LoadSampleAsset(game, "menu", "end.flac");
+	data->solo_sample = LoadSampleAsset(game, "menu", "solo.flac");
+	LoadBeatMap(game, &data->music_beats, "menu.flac", data->sample);
+	LoadBeatMap(game, &data->solo_beats, "solo.flac", data->solo_sample);
+	LoadLaneLayout(game, &data->layout, "lanes.ini");
+	data->particles = CreateParticlePool(game);
+	data->badguys = calloc(data->layout.count, sizeof(struct Badguy*));
 	(*progress)(game);
+	TraceInstant("menu: progress");
 
-	data->music = al_create_sample_instance(data->sample);
+	data->music = CreateSampleInstanceAsset(game, "menu", "music", data->sample);
 	al_attach_sample_instance_to_mixer(data->music, game->audio.music);
 	al_set_sample_instance_playmode(data->music, ALLEGRO_PLAYMODE_LOOP);
 
-	data->click = al_create_sample_instance(data->click_sample);
+	data->click = CreateSampleInstanceAsset(game, "menu", "click", data->click_sample);
 	al_attach_sample_instance_to_mixer(data->click, game->audio.fx);
 	al_set_sample_instance_playmode(data->click, ALLEGRO_PLAYMODE_ONCE);
 
-	data->quit = al_create_sample_instance(data->quit_sample);
+	data->quit = CreateSampleInstanceAsset(game, "menu", "quit", data->quit_sample);
 	al_attach_sample_instance_to_mixer(data->quit, game->audio.fx);
 	al_set_sample_instance_playmode(data->quit, ALLEGRO_PLAYMODE_ONCE);
 
-	data->solo = al_create_sample_instance(data->solo_sample);
+	data->solo = CreateSampleInstanceAsset(game, "menu", "solo", data->solo_sample);
 	al_attach_sample_instance_to_mixer(data->solo, game->audio.fx);
 	al_set_sample_instance_playmode(data->solo, ALLEGRO_PLAYMODE_ONCE);
 
-	data->end = al_create_sample_instance(data->end_sample);
+	data->end = CreateSampleInstanceAsset(game, "menu", "end", data->end_sample);
 	al_attach_sample_instance_to_mixer(data->end, game->audio.fx);
 	al_set_sample_instance_playmode(data->end, ALLEGRO_PLAYMODE_ONCE);
 
@@ -613,45 +759,55 @@ void* Gamestate_Load(struct Game *game, void (*progress)(struct Game*)) {
 	for (i=0; i<6; i++) {
 		char name[] = "chords/0.flac";
 		name[7] = '1' + i;
-		data->chord_samples[i] = al_load_sample( GetDataFilePath(game, name) );
+		data->chord_samples[i] = LoadSampleAsset(game, "menu", name);
 
-		data->chords[i] = al_create_sample_instance(data->chord_samples[i]);
+		data->chords[i] = CreateSampleInstanceAsset(game, "menu", name, data->chord_samples[i]);
 		al_attach_sample_instance_to_mixer(data->chords[i], game->audio.fx);
 		al_set_sample_instance_playmode(data->chords[i], ALLEGRO_PLAYMODE_ONCE);
 	}
 
+	data->music_spectrum = CreateSpectrumAnalyzer(game, game->audio.music);
+	data->fx_spectrum = CreateSpectrumAnalyzer(game, game->audio.fx);
+
 	if (!data->click_sample){
 		fprintf(stderr, "Audio clip sample not loaded!\n" );
 		exit(-1);
 	}
 	(*progress)(game);
+	TraceInstant("menu: progress");
 
-	data->font_title = al_load_font(GetDataFilePath(game, "fonts/MonkeyIsland.ttf"),24,0 );
-	data->font = al_load_font(GetDataFilePath(game, "fonts/MonkeyIsland.ttf"),8,0 );
+	data->font_title = LoadFontAsset(game, "menu", "fonts/MonkeyIsland.ttf", 24);
+	data->font = LoadFontAsset(game, "menu", "fonts/MonkeyIsland.ttf", 8);
 	(*progress)(game);
-
-	data->ego = CreateCharacter(game, "ego");
-	RegisterSpritesheet(game, data->ego, "stand");
-	RegisterSpritesheet(game, data->ego, "fix");
-	RegisterSpritesheet(game, data->ego, "fix2");
-	RegisterSpritesheet(game, data->ego, "fix3");
-	RegisterSpritesheet(game, data->ego, "play");
-	RegisterSpritesheet(game, data->ego, "cry");
-	LoadSpritesheets(game, data->ego);
-
-	data->cow = CreateCharacter(game, "cow");
-	RegisterSpritesheet(game, data->cow, "stand");
-	RegisterSpritesheet(game, data->cow, "chew");
-	RegisterSpritesheet(game, data->cow, "look");
-	LoadSpritesheets(game, data->cow);
-
-	data->badguy = CreateCharacter(game, "badguy");
-	RegisterSpritesheet(game, data->badguy, "walk");
-	RegisterSpritesheet(game, data->badguy, "melt");
-	LoadSpritesheets(game, data->badguy);
+	TraceInstant("menu: progress");
+
+	data->ego = CreateCharacterAsset(game, "ego");
+	RegisterSpritesheetAsset(game, data->ego, "stand");
+	RegisterSpritesheetAsset(game, data->ego, "fix");
+	RegisterSpritesheetAsset(game, data->ego, "fix2");
+	RegisterSpritesheetAsset(game, data->ego, "fix3");
+	RegisterSpritesheetAsset(game, data->ego, "play");
+	RegisterSpritesheetAsset(game, data->ego, "cry");
+	LoadSpritesheetAssets(game, "menu", data->ego);
+
+	data->cow = CreateCharacterAsset(game, "cow");
+	RegisterSpritesheetAsset(game, data->cow, "stand");
+	RegisterSpritesheetAsset(game, data->cow, "chew");
+	RegisterSpritesheetAsset(game, data->cow, "look");
+	LoadSpritesheetAssets(game, "menu", data->cow);
+
+	data->badguy = CreateCharacterAsset(game, "badguy");
+	RegisterSpritesheetAsset(game, data->badguy, "walk");
+	RegisterSpritesheetAsset(game, data->badguy, "melt");
+	LoadSpritesheetAssets(game, "menu", data->badguy);
 	(*progress)(game);
+	TraceInstant("menu: progress");
+
+	if (game->config.debug) DumpAssets(game, "menu");
+	CheckAssetBudget(game, "menu");
 
 	al_set_target_backbuffer(game->display);
+	TraceEnd("menu: Gamestate_Load");
 	return data;
 }
 
@@ -662,7 +818,7 @@ void DestroyBadguys(struct Game *game, struct MenuResources* data, int i) {
 		data->destroyQueue = NULL;
 	}
 	while (tmp) {
-		DestroyCharacter(game, tmp->character);
+		DestroyCharacterAsset(game, tmp->character);
 		struct Badguy *old = tmp;
 		tmp = tmp->next;
 		free(old);
@@ -674,90 +830,252 @@ void DestroyBadguys(struct Game *game, struct MenuResources* data, int i) {
 	data->badguys[i] = NULL;
 }
 
+#define SNAPSHOT_MELTING 4
+
+/*! \brief Gameplay state at the end of a tick, 44 bytes.
+ *
+ * Followed by the number of badguys in each lane, one byte per lane padded
+ * to SNAPSHOT_LANES, and then BadguySnapshot records lane by lane; with four
+ * lanes that's a 48-byte header and 12 bytes per badguy. Snapshots are
+ * hashed byte by byte, so every byte of them, padding too, gets written.
+ */
+struct MenuSnapshot {
+	uint32_t rng, music, solo; /*!< Music and solo positions in samples. */
+	int32_t score;
+	float badguySpeed, cloud_position;
+	int16_t markx, lightx, badguyRate, timeTillNextBadguy, spawnStep, soloready;
+	int8_t marky, lighty;
+	uint8_t usage, lightanim, soloanim, soloflash;
+	bool soloactive, spawnPending;
+};
+
+#define SNAPSHOT_LANES(count) (((count) + 3) & ~3)
+
+struct BadguySnapshot {
+	float x, pos_tmp;
+	uint8_t pos;
+	uint8_t state; /*!< Speed step (speed is 1 + step/4), with SNAPSHOT_MELTING set for melting ones. */
+	uint8_t pad[2]; /*!< Always zero. */
+};
+
+static void TakeSnapshot(struct Game *game, struct MenuResources* data) {
+	int i, count = 0;
+	for (i=0; i<data->layout.count; i++) {
+		struct Badguy *tmp = data->badguys[i];
+		int n;
+		for (n=0; tmp && (n < 255); tmp = tmp->next, n++) {
+			count++;
+		}
+	}
+	size_t header = sizeof(struct MenuSnapshot) + SNAPSHOT_LANES(data->layout.count);
+	size_t length = header + count * sizeof(struct BadguySnapshot);
+	unsigned char *buf = PushSnapshot(&data->snapshots, data->tick++, length);
+	if (!buf) return;
+	// the ring is reused without clearing, and leftovers in padding would change the hash
+	memset(buf, 0, length);
+
+	struct MenuSnapshot *s = (struct MenuSnapshot*)buf;
+	s->rng = data->rng.state;
+	s->music = al_get_sample_instance_position(data->music);
+	s->solo = al_get_sample_instance_position(data->solo);
+	s->score = data->score;
+	s->badguySpeed = data->badguySpeed;
+	s->cloud_position = data->cloud_position;
+	s->markx = data->markx;
+	s->lightx = data->lightx;
+	s->badguyRate = data->badguyRate;
+	s->timeTillNextBadguy = data->timeTillNextBadguy;
+	s->spawnStep = data->spawnStep;
+	s->soloready = data->soloready;
+	s->marky = data->marky;
+	s->lighty = data->lighty;
+	s->usage = data->usage;
+	s->lightanim = data->lightanim;
+	s->soloanim = data->soloanim;
+	s->soloflash = data->soloflash;
+	s->soloactive = data->soloactive;
+	s->spawnPending = data->spawnPending;
+
+	uint8_t *lanes = buf + sizeof(struct MenuSnapshot);
+	struct BadguySnapshot *b = (struct BadguySnapshot*)(buf + header);
+	for (i=0; i<data->layout.count; i++) {
+		struct Badguy *tmp = data->badguys[i];
+		for (lanes[i]=0; tmp && (lanes[i] < 255); lanes[i]++, tmp = tmp->next, b++) {
+			b->x = GetCharacterX(game, tmp->character);
+			b->pos_tmp = tmp->character->pos_tmp;
+			b->pos = tmp->character->pos;
+			b->state = (int)((tmp->speed - 1) * 4 + 0.5) | (tmp->melting ? SNAPSHOT_MELTING : 0);
+		}
+	}
+}
+
+/*! \brief Hands all badguys of given lane back to destroyQueue, keeping them for later spawns. */
+static void RecycleBadguys(struct Game *game, struct MenuResources* data, int i) {
+	struct Badguy *last = data->badguys[i];
+	if (!last) return;
+	last->character->dead = true;
+	while (last->next) {
+		last = last->next;
+		last->character->dead = true;
+	}
+	last->next = data->destroyQueue;
+	if (data->destroyQueue) data->destroyQueue->prev = last;
+	data->destroyQueue = data->badguys[i];
+	data->badguys[i] = NULL;
+}
+
+static void RestoreSnapshot(struct Game *game, struct MenuResources* data, const unsigned char *buf) {
+	const struct MenuSnapshot *s = (const struct MenuSnapshot*)buf;
+	data->rng.state = s->rng;
+	data->score = s->score;
+	data->badguySpeed = s->badguySpeed;
+	data->cloud_position = s->cloud_position;
+	data->markx = s->markx;
+	data->lightx = s->lightx;
+	data->badguyRate = s->badguyRate;
+	data->timeTillNextBadguy = s->timeTillNextBadguy;
+	data->spawnStep = s->spawnStep;
+	data->soloready = s->soloready;
+	data->marky = s->marky;
+	data->lighty = s->lighty;
+	data->usage = s->usage;
+	data->lightanim = s->lightanim;
+	data->soloanim = s->soloanim;
+	data->soloflash = s->soloflash;
+	data->soloactive = s->soloactive;
+	data->spawnPending = s->spawnPending;
+
+	al_set_sample_instance_position(data->music, s->music);
+	if (s->soloactive) {
+		if (!al_get_sample_instance_playing(data->solo)) al_play_sample_instance(data->solo);
+		al_set_sample_instance_position(data->solo, s->solo);
+	} else {
+		al_stop_sample_instance(data->solo);
+	}
+
+	const uint8_t *lanes = buf + sizeof(struct MenuSnapshot);
+	const struct BadguySnapshot *b = (const struct BadguySnapshot*)(lanes + SNAPSHOT_LANES(data->layout.count));
+	int i, n;
+	for (i=0; i<data->layout.count; i++) {
+		// rewinding happens every tick while the key is held, so it must not free the reserve
+		RecycleBadguys(game, data, i);
+		for (n=0; n<lanes[i]; n++, b++) {
+			struct Badguy *badguy = CreateBadguy(game, data, i, 1 + (b->state & (SNAPSHOT_MELTING - 1)) * 0.25);
+			if (b->state & SNAPSHOT_MELTING) {
+				SelectSpritesheet(game, badguy->character, "melt");
+				badguy->melting = true;
+			}
+			SetCharacterPosition(game, badguy->character, b->x, data->layout.lanes[i].y, 0);
+			badguy->character->pos = b->pos;
+			badguy->character->pos_tmp = b->pos_tmp;
+		}
+	}
+}
+
+/*! \brief Steps one tick back; the oldest snapshot stays, so holding the key just stops there. */
+static void RewindSnapshot(struct Game *game, struct MenuResources* data) {
+	uint32_t tick;
+	const unsigned char *buf = GetSnapshot(&data->snapshots, 1, NULL, &tick);
+	if (!buf) return;
+	RestoreSnapshot(game, data, buf);
+	DropSnapshots(&data->snapshots, 1);
+	data->tick = tick + 1;
+}
+
 void Gamestate_Stop(struct Game *game, struct MenuResources* data) {
+	SetAllocSteadyState(false);
 	al_stop_sample_instance(data->music);
+	// Gamestate_Start queues the idle animations again
+	ClearSchedule(data->schedule);
+
+	if (game->config.debug) {
+		DumpInputLatency(game, "menu", &data->input);
+		size_t length;
+		uint32_t tick;
+		const unsigned char *latest = GetSnapshot(&data->snapshots, 0, &length, &tick);
+		if (latest) {
+			PrintConsole(game, "menu: %d snapshots kept, tick %u state hash %08x.", data->snapshots.count, tick, HashSnapshot(latest, length));
+		}
+	}
 
 	int i;
-	for (i=0; i<4; i++) {
+	for (i=0; i<data->layout.count; i++) {
 		DestroyBadguys(game, data, i);
 	}
 }
 
 void Gamestate_Unload(struct Game *game, struct MenuResources* data) {
-	if (game->config.fx) {
+	bool farewell = game->config.fx;
+	if (farewell) {
 		al_clear_to_color(al_map_rgb(0,0,0));
 //		DrawConsole(game);
 		al_flip_display();
 		al_play_sample_instance(data->quit);
-		al_rest(0.3);
-		int i;
-		for (i=0;i<50; i++) {
-			al_rest(0.05);
-			ALLEGRO_KEYBOARD_STATE kb;
-			al_get_keyboard_state(&kb);
-			if (al_key_down(&kb, ALLEGRO_KEY_ESCAPE)) return;
-		}
 	}
 
-	al_destroy_bitmap(data->bg);
-	al_destroy_bitmap(data->cloud);
-	al_destroy_bitmap(data->grass);
-	al_destroy_bitmap(data->forest);
-	al_destroy_bitmap(data->stage);
-	al_destroy_bitmap(data->speaker);
-	al_destroy_bitmap(data->lines);
-	al_destroy_bitmap(data->cable);
-	al_destroy_bitmap(data->light);
-	al_destroy_bitmap(data->marksmall);
-	al_destroy_bitmap(data->markbig);
-	al_destroy_font(data->font_title);
-	al_destroy_font(data->font);
+	// everything but the quit sound is released while it plays;
+	// bitmaps, fonts and samples stay in the asset cache
+	DestroySpectrumAnalyzer(game, data->music_spectrum);
+	DestroySpectrumAnalyzer(game, data->fx_spectrum);
 	al_destroy_sample_instance(data->music);
 	al_destroy_sample_instance(data->click);
 	al_destroy_sample_instance(data->end);
-	al_destroy_sample_instance(data->quit);
 	al_destroy_sample_instance(data->solo);
-	al_destroy_sample(data->sample);
-	al_destroy_sample(data->click_sample);
-	al_destroy_sample(data->quit_sample);
-	al_destroy_sample(data->end_sample);
-	al_destroy_sample(data->solo_sample);
 	int i;
 	for (i=0; i<6; i++) {
 		al_destroy_sample_instance(data->chords[i]);
-		al_destroy_sample(data->chord_samples[i]);
 	}
-	DestroyCharacter(game, data->ego);
-	DestroyCharacter(game, data->cow);
-	DestroyCharacter(game, data->badguy);
-	TM_Destroy(data->timeline);
+	DestroyCharacterAsset(game, data->ego);
+	DestroyCharacterAsset(game, data->cow);
+	DestroyCharacterAsset(game, data->badguy);
+	DestroySchedule(data->schedule);
+	DestroyBeatMap(&data->music_beats);
+	DestroyBeatMap(&data->solo_beats);
+	DestroyLaneLayout(&data->layout);
+	DestroyParticlePool(data->particles);
+	free(data->badguys);
+
+	// exit as soon as the sound ends, or right away on ESC
+	while (farewell && al_get_sample_instance_playing(data->quit)) {
+		ALLEGRO_KEYBOARD_STATE kb;
+		al_get_keyboard_state(&kb);
+		if (al_key_down(&kb, ALLEGRO_KEY_ESCAPE)) break;
+		al_rest(0.01);
+	}
+	al_destroy_sample_instance(data->quit);
+	UntrackAssets(game, "menu");
+	DestroySnapshotRing(&data->snapshots);
 	free(data);
+	ReleaseGameData(game);
 }
 
 // TODO: refactor to single Enqueue_Anim
-bool Anim_CowLook(struct Game *game, struct TM_Action *action, enum TM_ActionState state) {
-	struct MenuResources *data = action->arguments->value;
-	if (state == TM_ACTIONSTATE_START) {
+bool Anim_CowLook(struct Game *game, struct ScheduledAction *action, enum ScheduleState state) {
+	struct MenuResources *data = GetScheduleArg(action, 0);
+	if (state == SCHEDULE_START) {
 		ChangeSpritesheet(game, data->cow, "look");
-		TM_AddQueuedBackgroundAction(data->timeline, &Anim_CowLook, TM_AddToArgs(NULL, 1, data), 54*1000, "cow_look");
+		RepeatAction(action, 54*1000);
 	}
 	return true;
 }
 
 void StartGame(struct Game *game, struct MenuResources *data) {
-	TM_CleanQueue(data->timeline);
-	TM_CleanBackgroundQueue(data->timeline);
+	ClearSchedule(data->schedule);
 	ChangeSpritesheet(game, data->ego, "play");
 	ChangeSpritesheet(game, data->cow, "chew");
 	ChangeMenuState(game,data,MENUSTATE_HIDDEN);
 	al_play_sample_instance(data->chords[0]);
+	// ticks of a session count from its start, and there's nothing before it to rewind to
+	data->tick = 0;
+	ClearSnapshots(&data->snapshots);
+	BeginTelemetrySession(game, data->layout.count);
 }
 
-bool Anim_FixGuitar(struct Game *game, struct TM_Action *action, enum TM_ActionState state) {
-	struct MenuResources *data = action->arguments->value;
-	if (state == TM_ACTIONSTATE_START) {
+bool Anim_FixGuitar(struct Game *game, struct ScheduledAction *action, enum ScheduleState state) {
+	struct MenuResources *data = GetScheduleArg(action, 0);
+	if (state == SCHEDULE_START) {
 		ChangeSpritesheet(game, data->ego, "fix");
-		TM_AddQueuedBackgroundAction(data->timeline, &Anim_FixGuitar, TM_AddToArgs(NULL, 1, data), 30*1000, "fix_guitar");
+		RepeatAction(action, 30*1000);
 	}
 	return true;
 }
@@ -770,18 +1088,19 @@ void Gamestate_Start(struct Game *game, struct MenuResources* data) {
 
 	data->score = 0;
 
-	data->markx = 119;
-	data->marky = 2;
+	data->marky = data->layout.start;
+	data->markx = data->layout.lanes[data->marky].min;
 
 	data->soloactive = false;
 	data->soloanim = 0;
 	data->soloflash = 0;
 	data->soloready = 0;
 
-	data->keys.key = 0;
-	data->keys.delay = 0;
-	data->keys.shift = false;
-	data->keys.lastkey = -1;
+	ReleaseInputKeys(&data->input);
+	SeedRandom(&data->rng, rand());
+	ClearSnapshots(&data->snapshots);
+	data->tick = 0;
+	data->rewinding = false;
 
 	data->lightanim=0;
 
@@ -792,23 +1111,28 @@ void Gamestate_Start(struct Game *game, struct MenuResources* data) {
 	SelectSpritesheet(game, data->ego, "stand");
 	SelectSpritesheet(game, data->cow, "chew");
 	ChangeMenuState(game,data,MENUSTATE_MAIN);
-	TM_AddQueuedBackgroundAction(data->timeline, &Anim_FixGuitar, TM_AddToArgs(NULL, 1, data), 15*1000, "fix_guitar");
-	TM_AddQueuedBackgroundAction(data->timeline, &Anim_CowLook, TM_AddToArgs(NULL, 1, data), 5*1000, "cow_look");
+	ScheduleQueuedBackground(data->schedule, &Anim_FixGuitar, 15*1000, "fix_guitar", 1, data);
+	ScheduleQueuedBackground(data->schedule, &Anim_CowLook, 5*1000, "cow_look", 1, data);
 	al_play_sample_instance(data->music);
 	al_rest(0.01); // poor man's synchronization
 
-	data->badguys[0] = NULL;
-	data->badguys[1] = NULL;
-	data->badguys[2] = NULL;
-	data->badguys[3] = NULL;
+	int i;
+	for (i=0; i<data->layout.count; i++) {
+		data->badguys[i] = NULL;
+	}
 	data->destroyQueue = NULL;
+	ReserveBadguys(game, data, BADGUY_RESERVE * data->layout.count);
+	ClearParticles(data->particles);
 
 	data->badguyRate = 100;
 	data->timeTillNextBadguy = 0;
+	data->spawnPending = false;
+	data->spawnStep = -1;
+	data->bass = 0;
+	data->treble = 0;
 }
 
-void Gamestate_ProcessEvent(struct Game *game, struct MenuResources* data, ALLEGRO_EVENT *ev) {
-	TM_HandleEvent(data->timeline, ev);
+static void ProcessEvent(struct Game *game, struct MenuResources* data, ALLEGRO_EVENT *ev) {
 
 	if ((data->menustate == MENUSTATE_ABOUT) && (ev->type == ALLEGRO_EVENT_KEY_DOWN)) {
 		ChangeMenuState(game, data, MENUSTATE_MAIN);
@@ -825,41 +1149,45 @@ void Gamestate_ProcessEvent(struct Game *game, struct MenuResources* data, ALLEG
 				case ALLEGRO_KEY_LEFT:
 				case ALLEGRO_KEY_RIGHT:
 				case ALLEGRO_KEY_SPACE:
-					if (data->keys.key != ev->keyboard.keycode) {
-						data->keys.key = ev->keyboard.keycode;
-						data->keys.delay = INT_MIN;
-					}
+					InputKeyDown(&data->input, &ev->keyboard);
 					break;
 				case ALLEGRO_KEY_ESCAPE:
+					InputHandled(&data->input, ev->keyboard.timestamp);
 					Gamestate_Stop(game, data);
 					Gamestate_Start(game, data);
 					break;
 				case ALLEGRO_KEY_LSHIFT:
 				case ALLEGRO_KEY_RSHIFT:
-					data->keys.shift = true;
+					data->input.shift = true;
+					break;
+				case ALLEGRO_KEY_BACKSPACE:
+					data->rewinding = game->config.debug;
 					break;
 				case ALLEGRO_KEY_ENTER:
+					InputHandled(&data->input, ev->keyboard.timestamp);
 					if ((!data->soloactive) && (data->soloready >= SOLO_MIN)) {
 						data->soloready = 0;
 						al_play_sample_instance(data->solo);
 						data->soloactive = true;
 						data->badguySpeed-=0.5;
+						RecordTelemetry(game, TELEMETRY_SOLO, data->tick, 0, data->score, 0, 0);
 					}
 					break;
 				default:
-					data->keys.key = 0;
+					data->input.key = 0;
 					break;
 			}
 		} else if (ev->type == ALLEGRO_EVENT_KEY_UP) {
 			switch (ev->keyboard.keycode) {
 				case ALLEGRO_KEY_LSHIFT:
 				case ALLEGRO_KEY_RSHIFT:
-					data->keys.shift = false;
+					data->input.shift = false;
+					break;
+				case ALLEGRO_KEY_BACKSPACE:
+					data->rewinding = false;
 					break;
 				default:
-					if (ev->keyboard.keycode == data->keys.key) {
-						data->keys.key = 0;
-					}
+					InputKeyUp(&data->input, &ev->keyboard);
 					break;
 			}
 		}
@@ -869,6 +1197,8 @@ void Gamestate_ProcessEvent(struct Game *game, struct MenuResources* data, ALLEG
 
 	if (ev->type != ALLEGRO_EVENT_KEY_DOWN) return;
 
+	InputHandled(&data->input, ev->keyboard.timestamp);
+
 	if (ev->keyboard.keycode==ALLEGRO_KEY_UP) {
 		data->selected--;
 		if ((data->selected == 2) && ((data->menustate==MENUSTATE_VIDEO) || (data->menustate==MENUSTATE_OPTIONS) || (data->menustate==MENUSTATE_AUDIO))) {
@@ -888,7 +1218,7 @@ void Gamestate_ProcessEvent(struct Game *game, struct MenuResources* data, ALLEG
 	}
 
 	if (ev->keyboard.keycode==ALLEGRO_KEY_ENTER) {
-		char *text;
+		char text[255];
 		al_play_sample_instance(data->click);
 		switch (data->menustate) {
 			case MENUSTATE_MAIN:
@@ -908,7 +1238,6 @@ void Gamestate_ProcessEvent(struct Game *game, struct MenuResources* data, ALLEG
 				}
 				break;
 			case MENUSTATE_AUDIO:
-				text = malloc(255*sizeof(char));
 				switch (data->selected) {
 					case 0:
 						game->config.music--;
@@ -935,7 +1264,6 @@ void Gamestate_ProcessEvent(struct Game *game, struct MenuResources* data, ALLEG
 						ChangeMenuState(game,data,MENUSTATE_OPTIONS);
 						break;
 				}
-				free(text);
 				break;
 			case MENUSTATE_OPTIONS:
 				switch (data->selected) {
@@ -981,12 +1309,10 @@ void Gamestate_ProcessEvent(struct Game *game, struct MenuResources* data, ALLEG
 
 
 						if (data->options.resolution > max) data->options.resolution = 1;
-						text = malloc(255*sizeof(char));
 						snprintf(text, 255, "%d", data->options.resolution * 320);
 						SetConfigOption(game, "SuperDerpy", "width", text);
 						snprintf(text, 255, "%d", data->options.resolution * 180);
 						SetConfigOption(game, "SuperDerpy", "height", text);
-						free(text);
 						al_resize_display(game->display, data->options.resolution * 320, data->options.resolution * 180);
 
 						if ((al_get_display_width(game->display) < (data->options.resolution * 320)) || (al_get_display_height(game->display) < (data->options.resolution * 180))) {
@@ -1056,6 +1382,24 @@ void Gamestate_ProcessEvent(struct Game *game, struct MenuResources* data, ALLEG
 	return;
 }
 
+void Gamestate_ProcessEvent(struct Game *game, struct MenuResources* data, ALLEGRO_EVENT *ev) {
+	BeginAllocPhase(ALLOC_PHASE_EVENT);
+	ProcessEvent(game, data, ev);
+	EndAllocPhase();
+}
+
 void Gamestate_Pause(struct Game *game, struct MenuResources* data) {}
 void Gamestate_Resume(struct Game *game, struct MenuResources* data) {}
-void Gamestate_Reload(struct Game *game, struct MenuResources* data) {}
+void Gamestate_Reload(struct Game *game, struct MenuResources* data) {
+	void **slots[] = {
+		(void**)&data->bg, (void**)&data->cloud, (void**)&data->grass, (void**)&data->forest,
+		(void**)&data->stage, (void**)&data->speaker, (void**)&data->lines, (void**)&data->cable,
+		(void**)&data->light, (void**)&data->marksmall, (void**)&data->markbig,
+		(void**)&data->sample, (void**)&data->click_sample, (void**)&data->quit_sample,
+		(void**)&data->end_sample, (void**)&data->solo_sample,
+		(void**)&data->chord_samples[0], (void**)&data->chord_samples[1], (void**)&data->chord_samples[2],
+		(void**)&data->chord_samples[3], (void**)&data->chord_samples[4], (void**)&data->chord_samples[5],
+		(void**)&data->font_title, (void**)&data->font
+	};
+	ReloadAssets(game, "menu", slots, sizeof(slots)/sizeof(slots[0]));
+}
@@ -0,0 +1,109 @@
+/*! \file governor.c
+ *  \brief Keeping frames within budget by trading optional effects for time.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include <libsuperderpy.h>
+
+void InitQualityGovernor(struct Game *game, struct QualityGovernor *governor) {
+	memset(governor, 0, sizeof(struct QualityGovernor));
+	governor->level = QUALITY_EFFECT_COUNT;
+	governor->calm_needed = GOVERNOR_CALM;
+	int rate = al_get_display_refresh_rate(game->display);
+	governor->budget = 1.0 / (rate > 0 ? rate : 60);
+
+	char *quality = getenv("RADIOEDIT_QUALITY");
+	if (quality && quality[0]) {
+		int level = atoi(quality);
+		governor->level = level < 0 ? 0 : (level > QUALITY_EFFECT_COUNT ? QUALITY_EFFECT_COUNT : level);
+		governor->pinned = true;
+	}
+}
+
+static void SetQualityLevel(struct QualityGovernor *governor, int level) {
+	governor->raised = level > governor->level;
+	governor->level = level;
+	governor->calm = 0;
+	LogEvent(LOG_QUALITY, level);
+}
+
+static void JudgeWindow(struct QualityGovernor *governor) {
+	if (governor->misses >= GOVERNOR_MISSES) {
+		if (governor->level > 0) {
+			if (governor->raised) {
+				// the raise was too optimistic, so wait longer before the next one
+				governor->calm_needed *= 2;
+				if (governor->calm_needed > GOVERNOR_MAX_CALM) governor->calm_needed = GOVERNOR_MAX_CALM;
+			}
+			SetQualityLevel(governor, governor->level - 1);
+		}
+	} else if (!governor->misses && (governor->busy < governor->budget * GOVERNOR_HEADROOM)) {
+		// with vsync the interval sits at the budget no matter how light the frame is,
+		// so headroom is judged by the time spent drawing
+		if ((governor->level < QUALITY_EFFECT_COUNT) && (++governor->calm >= governor->calm_needed)) {
+			SetQualityLevel(governor, governor->level + 1);
+		}
+	} else {
+		governor->calm = 0;
+	}
+	governor->frames = 0;
+	governor->misses = 0;
+	governor->busy = 0;
+}
+
+/*! \brief Marks the start of drawing a frame; the time since the previous one is its full interval. */
+void BeginGovernedFrame(struct Game *game) {
+	struct QualityGovernor *governor = &game->data->governor;
+	double now = al_get_time();
+	double interval = now - governor->last;
+	governor->last = now;
+	governor->start = now;
+	if (governor->pinned) return;
+	if (interval > GOVERNOR_GAP) {
+		// loading or a pause; whatever was measured before it is stale
+		governor->frames = 0;
+		governor->misses = 0;
+		governor->busy = 0;
+		return;
+	}
+	if (interval > governor->budget * GOVERNOR_SLOW) {
+		governor->misses++;
+	}
+	if (++governor->frames >= GOVERNOR_WINDOW) {
+		JudgeWindow(governor);
+	}
+}
+
+/*! \brief Marks the end of drawing a frame. */
+void EndGovernedFrame(struct Game *game) {
+	struct QualityGovernor *governor = &game->data->governor;
+	double busy = al_get_time() - governor->start;
+	if (busy > governor->busy) governor->busy = busy;
+}
+
+/*! \brief Whether given optional effect should be drawn at the current quality level. */
+bool HasQuality(struct Game *game, enum QualityEffect effect) {
+	return game->data->governor.level > effect;
+}
+
+/*! \brief Current quality level, from 0 with no optional effects up to QUALITY_EFFECT_COUNT. */
+int GetQualityLevel(struct Game *game) {
+	return game->data->governor.level;
+}
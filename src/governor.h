@@ -0,0 +1,45 @@
+#ifndef RADIOEDIT_GOVERNOR_H
+#define RADIOEDIT_GOVERNOR_H
+
+#include <stdbool.h>
+
+#define GOVERNOR_WINDOW 60 /*!< Frames judged together before the quality level may change. */
+#define GOVERNOR_SLOW 1.25 /*!< Frame interval, relative to the budget, counted as a missed frame. */
+#define GOVERNOR_MISSES 6 /*!< Missed frames in a window that make the quality drop. */
+#define GOVERNOR_HEADROOM 0.5 /*!< Drawing time, relative to the budget, considered safe for more effects. */
+#define GOVERNOR_CALM 2 /*!< Windows with headroom needed before raising the quality, doubled after each raise that didn't last. */
+#define GOVERNOR_MAX_CALM 32
+#define GOVERNOR_GAP 0.25 /*!< Longer pauses between frames, e.g. from loading, aren't counted at all. */
+
+struct Game;
+
+/*! \brief Optional effects, in the order they're brought back; the last one is the first to go. */
+enum QualityEffect {
+	QUALITY_TEXT_SHADOW, /*!< Drop shadow under menu text, costing a second pass over every string. */
+	QUALITY_CHECKERBOARD, /*!< Pixel grid over the dosowisko logo. */
+	QUALITY_INTRO_ZOOM, /*!< Zoom of the dosowisko logo, costing an extra full screen pass. */
+	QUALITY_CLOUD, /*!< Bigger cloud drifting over the menu. */
+	QUALITY_LIGHT_FLICKER, /*!< Stage light overlay flickering with the music. */
+	QUALITY_EFFECT_COUNT
+};
+
+/*! \brief Steps optional effects down when frames miss their budget and back up when there's headroom. */
+struct QualityGovernor {
+	int level; /*!< Number of enabled effects, QUALITY_EFFECT_COUNT being full quality. */
+	bool pinned; /*!< Level set through RADIOEDIT_QUALITY, never changed. */
+	double budget; /*!< Seconds per frame. */
+
+	double last, start; /*!< When the previous frame and the current one started drawing. */
+	int frames, misses;
+	double busy; /*!< Longest drawing time in the current window. */
+	int calm, calm_needed;
+	bool raised; /*!< Last change was a raise, so dropping again means it was premature. */
+};
+
+void InitQualityGovernor(struct Game *game, struct QualityGovernor *governor);
+void BeginGovernedFrame(struct Game *game);
+void EndGovernedFrame(struct Game *game);
+bool HasQuality(struct Game *game, enum QualityEffect effect);
+int GetQualityLevel(struct Game *game);
+
+#endif
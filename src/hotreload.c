@@ -0,0 +1,128 @@
+/*! \file hotreload.c
+ *  \brief Watching loose data files for changes.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include <libsuperderpy.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#ifdef __linux__
+
+struct AssetWatcher* CreateAssetWatcher(struct Game *game) {
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) {
+		PrintConsole(game, "Can't watch data files, asset hot-reload disabled.");
+		return NULL;
+	}
+	struct AssetWatcher *watcher = malloc(sizeof(struct AssetWatcher));
+	watcher->fd = fd;
+	PrintConsole(game, "Watching data files for changes.");
+	return watcher;
+}
+
+void DestroyAssetWatcher(struct AssetWatcher *watcher) {
+	if (!watcher) return;
+	close(watcher->fd);
+	free(watcher);
+}
+
+/*! \brief Starts watching the directory of a loose data file, returns its watch descriptor. */
+int WatchDataFile(struct Game *game, char* path) {
+	if (!game->data || !game->data->watcher) return -1;
+	char filename[1024];
+	if (!FindDataFile(game, path, filename, sizeof(filename))) {
+		return -1; // files inside the archive never change
+	}
+	char *slash = strrchr(filename, '/');
+	if (slash) *slash = 0;
+	// watching the same directory again just returns its existing descriptor
+	return inotify_add_watch(game->data->watcher->fd, slash ? filename : ".", IN_CLOSE_WRITE | IN_MOVED_TO);
+}
+
+static char* BaseName(char* path) {
+	char *slash = strrchr(path, '/');
+	return slash ? slash + 1 : path;
+}
+
+static bool SameStem(char* a, char* b) {
+	size_t len = strrchr(a, '.') ? (size_t)(strrchr(a, '.') - a) : strlen(a);
+	return !strncmp(a, b, len) && (b[len] == '.' || b[len] == 0);
+}
+
+static void MarkChanged(struct Game *game, int wd, char* name) {
+	struct AssetRecord *record = game->data->assets;
+	while (record) {
+		if (record->watch == wd) {
+			char *base = BaseName(record->path);
+			// spritesheets are made of a .png and an .ini sharing the same name
+			if (!strcmp(base, name) || ((record->kind == ASSET_SPRITESHEET) && SameStem(base, name))) {
+				record->dirty = true;
+			}
+		}
+		record = record->next;
+	}
+}
+
+/*! \brief Picks up pending file change notifications, returns whether given gamestate has assets to reload or to swap in. */
+bool PollAssetChanges(struct Game *game, char* owner) {
+	if (!game->data || !game->data->watcher) return false;
+	char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+	while ((len = read(game->data->watcher->fd, buffer, sizeof(buffer))) > 0) {
+		char *ptr = buffer;
+		while (ptr < buffer + len) {
+			struct inotify_event *event = (struct inotify_event*)ptr;
+			if (event->len) {
+				MarkChanged(game, event->wd, event->name);
+			}
+			ptr += sizeof(struct inotify_event) + event->len;
+		}
+	}
+	struct AssetRecord *record = game->data->assets;
+	while (record) {
+		bool decoded = record->reload && __atomic_load_n(&record->reload->done, __ATOMIC_ACQUIRE);
+		if ((record->dirty || decoded) && !strcmp(record->owner, owner)) {
+			return true;
+		}
+		record = record->next;
+	}
+	return false;
+}
+
+#else
+
+struct AssetWatcher* CreateAssetWatcher(struct Game *game) {
+	return NULL;
+}
+
+void DestroyAssetWatcher(struct AssetWatcher *watcher) {}
+
+int WatchDataFile(struct Game *game, char* path) {
+	return -1;
+}
+
+bool PollAssetChanges(struct Game *game, char* owner) {
+	return false;
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef RADIOEDIT_HOTRELOAD_H
+#define RADIOEDIT_HOTRELOAD_H
+
+#include <stdbool.h>
+
+struct Game;
+
+/*! \brief Watches loose data files for changes. */
+struct AssetWatcher {
+	int fd; /*!< inotify descriptor. */
+};
+
+struct AssetWatcher* CreateAssetWatcher(struct Game *game);
+void DestroyAssetWatcher(struct AssetWatcher *watcher);
+int WatchDataFile(struct Game *game, char* path);
+bool PollAssetChanges(struct Game *game, char* owner);
+
+#endif
@@ -0,0 +1,118 @@
+/*! \file input.c
+ *  \brief Key repeat and debounce driven by event timestamps, with latency statistics.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include <libsuperderpy.h>
+
+static void AddLatency(struct InputLatency *latency, double value) {
+	if (value < 0) value = 0;
+	latency->sum += value;
+	latency->last = value;
+	if (value > latency->max) latency->max = value;
+	latency->count++;
+}
+
+void InitInput(struct InputState *input) {
+	memset(input, 0, sizeof(struct InputState));
+}
+
+/*! \brief Forgets held keys, keeping the latency statistics. */
+void ReleaseInputKeys(struct InputState *input) {
+	input->key = 0;
+	input->shift = false;
+	input->next = 0;
+	input->released_key = 0;
+}
+
+/*! \brief Starts holding a repeatable key. */
+void InputKeyDown(struct InputState *input, ALLEGRO_KEYBOARD_EVENT *ev) {
+	if ((ev->keycode == input->released_key) && (ev->timestamp - input->released < INPUT_DEBOUNCE)) {
+		// some platforms report bogus release and press pairs while the key is held
+		input->key = ev->keycode;
+		input->released_key = 0;
+		return;
+	}
+	if (input->key == ev->keycode) return;
+	input->key = ev->keycode;
+	input->pressed = ev->timestamp;
+	input->next = 0;
+}
+
+void InputKeyUp(struct InputState *input, ALLEGRO_KEYBOARD_EVENT *ev) {
+	if (ev->keycode != input->key) return;
+	input->key = 0;
+	input->released_key = ev->keycode;
+	input->released = ev->timestamp;
+}
+
+/*! \brief Called once per logic tick; returns the held key if it fires during this tick, 0 otherwise.
+ *
+ * A fresh press always fires on the first tick after its event.
+ */
+int PollInput(struct InputState *input) {
+	if (!input->key) return 0;
+	double now = al_get_time();
+	if (!input->next) {
+		InputHandled(input, input->pressed);
+		input->next = input->pressed + INPUT_REPEAT_DELAY;
+		return input->key;
+	}
+	if (now < input->next) return 0;
+	input->next += INPUT_REPEAT_INTERVAL;
+	if (input->next < now) {
+		input->next = now; // don't burst repeats after a stall
+	}
+	return input->key;
+}
+
+/*! \brief Records the logic latency of an event which has just been acted upon. */
+void InputHandled(struct InputState *input, double timestamp) {
+	AddLatency(&input->logic, al_get_time() - timestamp);
+	if (!input->handled) input->handled = timestamp;
+}
+
+/*! \brief Called at the end of drawing; the effects of events handled so far are in this frame. */
+void InputFrameDrawn(struct InputState *input) {
+	if (input->handled && !input->drawn) {
+		input->drawn = input->handled;
+		input->handled = 0;
+	}
+}
+
+/*! \brief Called when the gamestate gets control again, which is after the frame drawn last was flipped.
+ *
+ * As with TraceFramePresented, this gives an upper bound of the presentation time.
+ */
+void InputFramePresented(struct InputState *input) {
+	if (!input->drawn) return;
+	AddLatency(&input->present, al_get_time() - input->drawn);
+	input->drawn = 0;
+}
+
+void DumpInputLatency(struct Game *game, char* gamestate, struct InputState *input) {
+	if (!input->logic.count) return;
+	PrintConsole(game, "%s: input latency to logic: avg %.2f ms, max %.2f ms over %d events%s", gamestate,
+	             input->logic.sum / input->logic.count * 1000, input->logic.max * 1000, input->logic.count,
+	             input->logic.max <= 1/60.0 ? " (all within one tick)" : "");
+	if (!input->present.count) return;
+	PrintConsole(game, "%s: input latency to present: avg %.2f ms, max %.2f ms over %d frames", gamestate,
+	             input->present.sum / input->present.count * 1000, input->present.max * 1000, input->present.count);
+}
@@ -0,0 +1,46 @@
+#ifndef RADIOEDIT_INPUT_H
+#define RADIOEDIT_INPUT_H
+
+#include <allegro5/allegro.h>
+
+struct Game;
+
+/*! \brief Hold time before a held key starts repeating, in seconds. */
+#define INPUT_REPEAT_DELAY 0.23
+/*! \brief Time between repeats of a held key, in seconds. */
+#define INPUT_REPEAT_INTERVAL (1/30.0)
+/*! \brief A release followed by a press of the same key within this time is treated as still held. */
+#define INPUT_DEBOUNCE 0.02
+
+/*! \brief Running statistics of a latency, in seconds. */
+struct InputLatency {
+	double sum, max, last;
+	int count;
+};
+
+/*! \brief Held key with repeat state, all times being Allegro event timestamps. */
+struct InputState {
+	int key; /*!< Currently held key, 0 if none. */
+	bool shift;
+	double pressed; /*!< Time of the event which pressed the key. */
+	double next; /*!< Time at which the held key fires next; 0 until the press was handled. */
+	int released_key; /*!< Key released last, for debouncing. */
+	double released; /*!< Time of the last release. */
+
+	double handled; /*!< Time of the event handled since last draw, 0 if none. */
+	double drawn; /*!< Time of the event handled in the frame drawn last, 0 if none. */
+	struct InputLatency logic; /*!< From event to the logic tick acting on it. */
+	struct InputLatency present; /*!< From event to the frame showing its effect. */
+};
+
+void InitInput(struct InputState *input);
+void ReleaseInputKeys(struct InputState *input);
+void InputKeyDown(struct InputState *input, ALLEGRO_KEYBOARD_EVENT *ev);
+void InputKeyUp(struct InputState *input, ALLEGRO_KEYBOARD_EVENT *ev);
+int PollInput(struct InputState *input);
+void InputHandled(struct InputState *input, double timestamp);
+void InputFrameDrawn(struct InputState *input);
+void InputFramePresented(struct InputState *input);
+void DumpInputLatency(struct Game *game, char* gamestate, struct InputState *input);
+
+#endif
@@ -0,0 +1,99 @@
+/*! \file lanelayout.c
+ *  \brief Loading the lane layout of the stage.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include "common.h"
+#include <libsuperderpy.h>
+
+/*! \brief The four lanes of the stage, used when the layout file is missing or broken. */
+static const struct Lane default_lanes[] = {
+	{ 108, 0.17, 139, 129, 128, false, -172, -39 },
+	{ 121, 0.18, 129, 119, 140, false, -172, -27 },
+	{ 134, 0.19, 119, 109, 152, true, -171, -14 },
+	{ 147, 0.2, 109, 99, 166, true, -171, 0 },
+};
+
+static bool ReadLane(ALLEGRO_CONFIG *config, int i, struct Lane *lane) {
+	char section[32];
+	snprintf(section, sizeof(section), "lane %d", i);
+	const char *y = al_get_config_value(config, section, "y");
+	const char *speed = al_get_config_value(config, section, "speed");
+	const char *min = al_get_config_value(config, section, "min");
+	const char *end = al_get_config_value(config, section, "end");
+	const char *marker = al_get_config_value(config, section, "marker");
+	const char *mark = al_get_config_value(config, section, "mark");
+	const char *light = al_get_config_value(config, section, "light");
+	if (!y || !speed || !min || !end || !marker || !mark || !light) return false;
+	lane->y = atoi(y);
+	lane->speed = atof(speed);
+	lane->min = atoi(min);
+	lane->end = atoi(end);
+	lane->marker = atoi(marker);
+	lane->big = !strcmp(mark, "big");
+	return sscanf(light, "%d %d", &lane->light_x, &lane->light_y) == 2;
+}
+
+static bool ReadLaneLayout(struct Game *game, struct LaneLayout *layout, char* path) {
+	ALLEGRO_FILE *file = OpenDataFile(game, path);
+	ALLEGRO_CONFIG *config = file ? al_load_config_file_f(file) : NULL;
+	if (file) al_fclose(file);
+	if (!config) return false;
+	const char *lanes = al_get_config_value(config, "layout", "lanes");
+	const char *start = al_get_config_value(config, "layout", "start");
+	int count = lanes ? atoi(lanes) : 0;
+	bool valid = (count > 0) && (count <= LANE_LAYOUT_MAX);
+	if (valid) {
+		layout->lanes = malloc(count * sizeof(struct Lane));
+		int i;
+		for (i=0; valid && (i<count); i++) {
+			valid = ReadLane(config, i, &layout->lanes[i]);
+		}
+		layout->count = count;
+		layout->start = start ? atoi(start) : 0;
+		if ((layout->start < 0) || (layout->start >= count)) layout->start = 0;
+	}
+	al_destroy_config(config);
+	if (!valid) {
+		PrintConsole(game, "Lane layout %s is invalid, ignoring.", path);
+		DestroyLaneLayout(layout);
+	}
+	return valid;
+}
+
+/*! \brief Loads lanes from given data file, falling back to the four lanes of the stage. */
+void LoadLaneLayout(struct Game *game, struct LaneLayout *layout, char* path) {
+	layout->count = 0;
+	layout->lanes = NULL;
+	if (DataFileExists(game, path) && ReadLaneLayout(game, layout, path)) {
+		PrintConsole(game, "Lane layout %s: %d lanes.", path, layout->count);
+		return;
+	}
+	layout->count = sizeof(default_lanes) / sizeof(struct Lane);
+	layout->start = 2;
+	layout->lanes = malloc(sizeof(default_lanes));
+	memcpy(layout->lanes, default_lanes, sizeof(default_lanes));
+}
+
+void DestroyLaneLayout(struct LaneLayout *layout) {
+	free(layout->lanes);
+	layout->lanes = NULL;
+	layout->count = 0;
+}
@@ -0,0 +1,31 @@
+#ifndef RADIOEDIT_LANELAYOUT_H
+#define RADIOEDIT_LANELAYOUT_H
+
+#include <stdbool.h>
+
+struct Game;
+
+#define LANE_LAYOUT_MAX 100 /*!< Most lanes a layout may have; snapshots store the marker lane in a byte. */
+
+/*! \brief Geometry of one lane, see data/lanes.ini. */
+struct Lane {
+	int y; /*!< Where badguys walk. */
+	float speed; /*!< Pixels walked per tick at normal speed. */
+	int min; /*!< Leftmost position of the marker. */
+	int end; /*!< Badguys reaching it end the game. */
+	int marker; /*!< Vertical position of the marker. */
+	bool big; /*!< Whether the big marker is used. */
+	int light_x, light_y; /*!< Offset of the light flash from the marker. */
+};
+
+/*! \brief Lanes badguys walk along, from the top of the stage down. */
+struct LaneLayout {
+	int count;
+	int start; /*!< Lane the marker starts in. */
+	struct Lane *lanes;
+};
+
+void LoadLaneLayout(struct Game *game, struct LaneLayout *layout, char* path);
+void DestroyLaneLayout(struct LaneLayout *layout);
+
+#endif
@@ -0,0 +1,195 @@
+/*! \file latency.c
+ *  \brief Measuring the latency from key presses to chords being heard.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Presses travel nearly the whole way a real key does: an event queue, the
+// gamestate's ProcessEvent, the held key being polled by Logic and Fire()
+// starting the chord, which the mixer then picks up on its next buffer. The
+// queue is the probe's own and is read at the start of Logic, so presses wait
+// for the next tick just like keys which arrive between ticks do.
+// On a headless machine, point ALSA's default device at snd-aloop or a null
+// plugin and run with e.g. RADIOEDIT_LATENCY=200.
+
+#include <stdio.h>
+#include "common.h"
+#include <libsuperderpy.h>
+
+static void EmitKey(struct LatencyProbe *probe, ALLEGRO_EVENT_TYPE type, int keycode, double time) {
+	ALLEGRO_EVENT ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.user.type = LATENCY_EVENT_TYPE;
+	ev.user.data1 = type;
+	ev.user.data2 = keycode;
+	ev.user.data3 = (intptr_t)(time * 1000000);
+	al_emit_user_event(&probe->source, &ev, NULL);
+}
+
+/*! \brief Sleeps for given time, returning early when the probe is being destroyed. */
+static bool Wait(struct LatencyProbe *probe, double time) {
+	double until = al_get_time() + time;
+	while (!__atomic_load_n(&probe->done, __ATOMIC_ACQUIRE)) {
+		double left = until - al_get_time();
+		if (left <= 0) return true;
+		al_rest(left < 0.01 ? left : 0.01);
+	}
+	return false;
+}
+
+/*! \brief Claims the waiting press; only one of the injector and the audio thread gets it. */
+static bool Disarm(struct LatencyProbe *probe) {
+	int armed = 1;
+	return __atomic_compare_exchange_n(&probe->armed, &armed, 0, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static void* InjectorThread(ALLEGRO_THREAD *thread, void *arg) {
+	struct LatencyProbe *probe = arg;
+	struct Random random;
+	SeedRandom(&random, 0x1a7e);
+	while (Wait(probe, LATENCY_INTERVAL + LATENCY_JITTER * RandomInt(&random, 1000) / 1000.0)) {
+		if (__atomic_load_n(&probe->armed, __ATOMIC_ACQUIRE) && (al_get_time() - probe->pressed > LATENCY_TIMEOUT)) {
+			if (Disarm(probe)) __atomic_add_fetch(&probe->missed, 1, __ATOMIC_RELEASE);
+		}
+		if (__atomic_load_n(&probe->count, __ATOMIC_ACQUIRE) + __atomic_load_n(&probe->missed, __ATOMIC_ACQUIRE) >= probe->wanted) break;
+		if (__atomic_load_n(&probe->armed, __ATOMIC_ACQUIRE)) continue;
+
+		double now = al_get_time();
+		int key = ALLEGRO_KEY_ENTER;
+		if (__atomic_load_n(&probe->playing, __ATOMIC_ACQUIRE)) {
+			key = ALLEGRO_KEY_SPACE;
+			probe->pressed = now;
+			__atomic_store_n(&probe->armed, 1, __ATOMIC_RELEASE);
+		}
+		EmitKey(probe, ALLEGRO_EVENT_KEY_DOWN, key, now);
+		if (!Wait(probe, LATENCY_HOLD)) break;
+		EmitKey(probe, ALLEGRO_EVENT_KEY_UP, key, al_get_time());
+	}
+	return NULL;
+}
+
+static void DetectOnset(const float *buffer, unsigned int samples, int channels, void *userdata) {
+	struct LatencyProbe *probe = userdata;
+	double now = al_get_time();
+	unsigned int i, j;
+	for (i=0; i<samples; i+=LATENCY_WINDOW) {
+		unsigned int end = i + LATENCY_WINDOW < samples ? i + LATENCY_WINDOW : samples;
+		float energy = 0;
+		for (j=i*channels; j<end*channels; j++) {
+			energy += buffer[j] * buffer[j];
+		}
+		energy /= (end - i) * channels;
+		bool onset = (energy > LATENCY_ONSET_FLOOR) && (energy > probe->average * LATENCY_ONSET_RATIO);
+		probe->average = probe->average * 0.98f + energy * 0.02f;
+		if (onset && __atomic_load_n(&probe->armed, __ATOMIC_ACQUIRE) && Disarm(probe)) {
+			int n = probe->count;
+			if (n < probe->wanted) {
+				probe->results[n] = now + i / (double)probe->frequency - probe->pressed;
+			}
+			__atomic_store_n(&probe->count, n + 1, __ATOMIC_RELEASE);
+		}
+	}
+}
+
+struct LatencyProbe* CreateLatencyProbe(struct Game *game) {
+	char *presses = getenv("RADIOEDIT_LATENCY");
+	if (!presses || (atoi(presses) <= 0)) return NULL;
+	if (!game->audio.fx) {
+		PrintConsole(game, "No audio, latency can't be measured.");
+		return NULL;
+	}
+	struct LatencyProbe *probe = calloc(1, sizeof(struct LatencyProbe));
+	probe->wanted = atoi(presses);
+	probe->results = calloc(probe->wanted, sizeof(double));
+	probe->frequency = al_get_mixer_frequency(game->audio.fx);
+	probe->tap = AddAudioTap(game, game->audio.fx, DetectOnset, probe);
+	al_init_user_event_source(&probe->source);
+	probe->queue = al_create_event_queue();
+	al_register_event_source(probe->queue, &probe->source);
+	probe->thread = al_create_thread(InjectorThread, probe);
+	al_start_thread(probe->thread);
+	PrintConsole(game, "Measuring key to audio latency over %d presses.", probe->wanted);
+	return probe;
+}
+
+void DestroyLatencyProbe(struct Game *game, struct LatencyProbe *probe) {
+	if (!probe) return;
+	__atomic_store_n(&probe->done, true, __ATOMIC_RELEASE);
+	al_join_thread(probe->thread, NULL);
+	al_destroy_thread(probe->thread);
+	al_destroy_event_queue(probe->queue);
+	al_destroy_user_event_source(&probe->source);
+	RemoveAudioTap(game, probe->tap);
+	free(probe->results);
+	free(probe);
+}
+
+/*! \brief Takes the next press emitted by the probe as the key event it stands for; false when there's none left. */
+bool PollLatencyEvent(struct Game *game, ALLEGRO_EVENT *ev) {
+	struct LatencyProbe *probe = game->data->latency;
+	ALLEGRO_EVENT user;
+	if (!probe || !al_get_next_event(probe->queue, &user)) return false;
+	memset(ev, 0, sizeof(ALLEGRO_EVENT));
+	ev->keyboard.type = user.user.data1;
+	ev->keyboard.keycode = user.user.data2;
+	ev->keyboard.timestamp = user.user.data3 / 1000000.0;
+	return true;
+}
+
+static int CompareLatencies(const void *a, const void *b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+static void Report(struct LatencyProbe *probe, int count, int missed) {
+	qsort(probe->results, count, sizeof(double), CompareLatencies);
+	double sum = 0;
+	int i;
+	for (i=0; i<count; i++) {
+		sum += probe->results[i];
+	}
+	fprintf(stderr, "Key to fx mixer latency over %d presses (%d missed), %u Hz:\n", count, missed, probe->frequency);
+	if (!count) return;
+	fprintf(stderr, "  min %.2f ms, avg %.2f ms, median %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+	        probe->results[0] * 1000, sum / count * 1000, probe->results[count / 2] * 1000,
+	        probe->results[count * 90 / 100] * 1000, probe->results[count * 99 / 100] * 1000, probe->results[count - 1] * 1000);
+	// a coarse histogram shows whether the spread comes from ticks or from audio buffers
+	int buckets[10] = {0};
+	double width = (probe->results[count - 1] - probe->results[0]) / 10;
+	if (width < 0.00001) return;
+	for (i=0; i<count; i++) {
+		int bucket = (probe->results[i] - probe->results[0]) / width;
+		buckets[bucket > 9 ? 9 : bucket]++;
+	}
+	for (i=0; i<10; i++) {
+		fprintf(stderr, "  %7.2f ms %5d\n", (probe->results[0] + width * i) * 1000, buckets[i]);
+	}
+}
+
+/*! \brief Tells the probe whether gameplay is running, once per tick; returns true on the tick all presses are done and reported. */
+bool UpdateLatencyProbe(struct Game *game, bool playing) {
+	struct LatencyProbe *probe = game->data->latency;
+	if (!probe || probe->reported) return false;
+	__atomic_store_n(&probe->playing, playing, __ATOMIC_RELEASE);
+	int count = __atomic_load_n(&probe->count, __ATOMIC_ACQUIRE);
+	int missed = __atomic_load_n(&probe->missed, __ATOMIC_ACQUIRE);
+	if (count + missed < probe->wanted) return false;
+	Report(probe, count, missed);
+	probe->reported = true;
+	return true;
+}
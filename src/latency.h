@@ -0,0 +1,52 @@
+#ifndef RADIOEDIT_LATENCY_H
+#define RADIOEDIT_LATENCY_H
+
+#include <allegro5/allegro.h>
+
+struct Game;
+struct AudioTap;
+
+#define LATENCY_EVENT_TYPE ALLEGRO_GET_EVENT_TYPE('R', 'L', 'A', 'T') /*!< Synthetic key event; data1 is the key event type, data2 the keycode, data3 the press time in microseconds. */
+#define LATENCY_INTERVAL 0.6 /*!< Shortest time between presses in seconds, over the 30 tick chord cooldown. */
+#define LATENCY_JITTER 0.3 /*!< Random extra time between presses, so they land anywhere within ticks and audio buffers. */
+#define LATENCY_HOLD 0.05 /*!< How long a press is held. */
+#define LATENCY_TIMEOUT 1.0 /*!< Seconds a press waits for its chord before it's counted as missed. */
+#define LATENCY_WINDOW 32 /*!< Samples per window the onset detector looks at. */
+#define LATENCY_ONSET_RATIO 8 /*!< Window energy over the running average which counts as an onset. */
+#define LATENCY_ONSET_FLOOR 1e-4 /*!< Window energy below which nothing counts as an onset. */
+
+/*! \brief Harness measuring the time from a SPACE key event to its chord coming out of the fx mixer.
+ *
+ * Enabled by setting RADIOEDIT_LATENCY to the number of presses to measure.
+ * An injector thread emits synthetic key events into the probe's own event
+ * queue, starting a game from the menu with ENTER and firing with SPACE once
+ * it's running; the menu's Logic takes them with PollLatencyEvent. An audio
+ * tap on the fx mixer looks for the chord's onset; the distribution of
+ * latencies is printed to stderr once all presses are done, after which the
+ * menu quits. Onsets are timed when the mixer produces them, so the device's
+ * own buffering isn't included.
+ */
+struct LatencyProbe {
+	int wanted; /*!< Presses to measure. */
+	double *results; /*!< Latencies in seconds, written by the audio thread. */
+	int count; /*!< Presses which got their chord. */
+	int missed; /*!< Presses which didn't, e.g. during a solo. */
+	double pressed; /*!< Time of the press being waited for. */
+	int armed; /*!< A press is waiting for its chord; whoever clears it accounts for the press. */
+	float average; /*!< Running energy of fx mixer windows, audio thread only. */
+	unsigned int frequency;
+	bool playing; /*!< The menu is in gameplay, so presses go to SPACE. */
+	bool done;
+	bool reported;
+	ALLEGRO_EVENT_SOURCE source;
+	ALLEGRO_EVENT_QUEUE *queue; /*!< Holds emitted presses until the game thread polls them. */
+	ALLEGRO_THREAD *thread;
+	struct AudioTap *tap;
+};
+
+struct LatencyProbe* CreateLatencyProbe(struct Game *game);
+void DestroyLatencyProbe(struct Game *game, struct LatencyProbe *probe);
+bool PollLatencyEvent(struct Game *game, ALLEGRO_EVENT *ev);
+bool UpdateLatencyProbe(struct Game *game, bool playing);
+
+#endif
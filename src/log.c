@@ -0,0 +1,190 @@
+/*! \file log.c
+ *  \brief Event log formatted and printed off the game thread.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Like tracing, logging covers the whole process and every thread,
+// so its state is kept here instead of in struct CommonResources.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <allegro5/allegro.h>
+#include "log.h"
+#include "trace.h"
+
+#define LOG_RING_SIZE 1024 /*!< Records per thread, must be a power of two. */
+#define LOG_INTERVAL 0.01 /*!< Seconds the logging thread sleeps after emptying the rings. */
+
+struct LogRecord {
+	double timestamp;
+	enum LogEventId id;
+	int32_t args[LOG_ARGS];
+};
+
+/*! \brief Single-producer single-consumer ring of the thread which owns it. */
+struct LogRing {
+	struct LogRecord records[LOG_RING_SIZE];
+	unsigned int head; /*!< Written only by the owning thread. */
+	unsigned int tail; /*!< Written only by the logging thread. */
+	unsigned int dropped;
+	struct LogRing *next;
+};
+
+static const struct {
+	enum LogCategory category;
+	int args;
+	const char *format;
+} log_events[LOG_EVENT_COUNT] = {
+#define LOG_EVENT_INFO(id, category, args, format) { category, args, format },
+	LOG_EVENTS(LOG_EVENT_INFO)
+#undef LOG_EVENT_INFO
+};
+
+static const char *log_categories[LOG_CATEGORY_COUNT] = {
+	"menu", "gameplay", "audio", "video", "memory"
+};
+
+unsigned int log_mask = 0;
+
+static struct {
+	bool running, done;
+	double start;
+	ALLEGRO_THREAD *thread;
+	ALLEGRO_MUTEX *mutex; /*!< Guards registering new rings only. */
+	struct LogRing *rings;
+} logger;
+
+static __thread struct LogRing *local_ring;
+
+static void PrintLogRecord(struct LogRecord *record) {
+	char message[256];
+	snprintf(message, sizeof(message), log_events[record->id].format, record->args[0], record->args[1], record->args[2]);
+	fprintf(stderr, "[%10.3f] %s: %s\n", (record->timestamp - logger.start) / 1000000.0, log_categories[log_events[record->id].category], message);
+}
+
+static int DrainLogRing(struct LogRing *ring) {
+	unsigned int tail = ring->tail, head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	int count = head - tail;
+	for (; tail != head; tail++) {
+		PrintLogRecord(&ring->records[tail % LOG_RING_SIZE]);
+	}
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	return count;
+}
+
+static void* LogThread(ALLEGRO_THREAD *thread, void *arg) {
+	while (true) {
+		bool done = __atomic_load_n(&logger.done, __ATOMIC_ACQUIRE);
+		int count = 0;
+		struct LogRing *ring;
+		for (ring = __atomic_load_n(&logger.rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+			count += DrainLogRing(ring);
+		}
+		if (done) break;
+		if (!count) al_rest(LOG_INTERVAL);
+	}
+	fflush(stderr);
+	return NULL;
+}
+
+static unsigned int ParseLogCategories(const char *names) {
+	if (!strcmp(names, "all")) return ~0u;
+	unsigned int mask = 0;
+	int i;
+	for (i=0; i<LOG_CATEGORY_COUNT; i++) {
+		const char *found = strstr(names, log_categories[i]);
+		size_t length = strlen(log_categories[i]);
+		if (found && ((found == names) || (found[-1] == ',')) && ((found[length] == ',') || !found[length])) {
+			mask |= 1u << i;
+		}
+	}
+	return mask;
+}
+
+/*! \brief Enables categories requested by RADIOEDIT_LOG, or all of them when verbose, and starts the logging thread. */
+void StartLog(bool verbose) {
+	const char *names = getenv("RADIOEDIT_LOG");
+	unsigned int mask = (names && names[0]) ? ParseLogCategories(names) : (verbose ? ~0u : 0);
+	logger.start = TraceClock();
+	if (mask) {
+		logger.mutex = al_create_mutex();
+		logger.thread = al_create_thread(LogThread, NULL);
+		if (logger.thread) {
+			logger.running = true;
+			al_start_thread(logger.thread);
+		}
+	}
+	__atomic_store_n(&log_mask, mask, __ATOMIC_RELEASE);
+}
+
+static struct LogRing* RegisterLogRing(void) {
+	struct LogRing *ring = calloc(1, sizeof(struct LogRing));
+	al_lock_mutex(logger.mutex);
+	ring->next = logger.rings;
+	__atomic_store_n(&logger.rings, ring, __ATOMIC_RELEASE);
+	al_unlock_mutex(logger.mutex);
+	local_ring = ring;
+	return ring;
+}
+
+/*! \brief Use LogEvent instead, which skips disabled categories without a call. */
+void WriteLogEvent(enum LogEventId id, ...) {
+	struct LogRecord record = { TraceClock(), id, { 0 } };
+	va_list ap;
+	va_start(ap, id);
+	int i;
+	for (i=0; i<log_events[id].args; i++) {
+		record.args[i] = va_arg(ap, int);
+	}
+	va_end(ap);
+
+	if (!__atomic_load_n(&logger.running, __ATOMIC_ACQUIRE)) {
+		// before StartLog or after FinishLog there's nobody to hand it over to
+		PrintLogRecord(&record);
+		return;
+	}
+	struct LogRing *ring = local_ring ? local_ring : RegisterLogRing();
+	unsigned int head = ring->head;
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SIZE) {
+		__atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	ring->records[head % LOG_RING_SIZE] = record;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*! \brief Prints everything still queued and stops the logging thread; later events are printed right away. */
+void FinishLog(void) {
+	if (!logger.running) return;
+	__atomic_store_n(&logger.running, false, __ATOMIC_RELEASE);
+	__atomic_store_n(&logger.done, true, __ATOMIC_RELEASE);
+	al_join_thread(logger.thread, NULL);
+	al_destroy_thread(logger.thread);
+	struct LogRing *ring;
+	unsigned int dropped = 0;
+	// rings stay allocated, as other threads still hold pointers to theirs
+	for (ring = logger.rings; ring; ring = ring->next) {
+		dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+	}
+	if (dropped) {
+		fprintf(stderr, "%u log events dropped, the logging thread couldn't keep up.\n", dropped);
+	}
+}
@@ -0,0 +1,64 @@
+#ifndef RADIOEDIT_LOG_H
+#define RADIOEDIT_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Structured logging for hot paths: LogEvent stores an event ID with its
+ * integer arguments in a ring owned by the calling thread, and a background
+ * thread formats and prints them. Categories are enabled at runtime through
+ * RADIOEDIT_LOG (comma separated names, or "all"; everything in debug mode
+ * by default) and can be compiled out by defining LOG_COMPILED_CATEGORIES
+ * to a mask of the categories to keep. */
+
+enum LogCategory {
+	LOG_MENU,
+	LOG_GAMEPLAY,
+	LOG_AUDIO,
+	LOG_VIDEO,
+	LOG_MEMORY,
+	LOG_CATEGORY_COUNT
+};
+
+#define LOG_ARGS 3 /*!< Most arguments an event can have; all of them are ints. */
+
+/* X(id, category, number of arguments, format) */
+#define LOG_EVENTS(X) \
+	X(LOG_MENU_STATE, LOG_MENU, 1, "menu state changed %d") \
+	X(LOG_CLOUD_WRAP, LOG_MENU, 0, "cloud_position") \
+	X(LOG_CHORD, LOG_AUDIO, 1, "playing chord nr %d") \
+	X(LOG_SOLO_BLAST, LOG_GAMEPLAY, 0, "BLAAAST") \
+	X(LOG_QUALITY, LOG_VIDEO, 1, "quality level %d") \
+	X(LOG_FRAME_ALLOCS, LOG_MEMORY, 3, "frame allocated %d times in Logic, %d in Draw, %d in ProcessEvent")
+
+#define LOG_EVENT_ID(id, category, args, format) id,
+enum LogEventId {
+	LOG_EVENTS(LOG_EVENT_ID)
+	LOG_EVENT_COUNT
+};
+#undef LOG_EVENT_ID
+
+#define LOG_EVENT_CATEGORY(id, category, args, format) id##_CATEGORY = category,
+enum {
+	LOG_EVENTS(LOG_EVENT_CATEGORY)
+};
+#undef LOG_EVENT_CATEGORY
+
+#ifndef LOG_COMPILED_CATEGORIES
+#define LOG_COMPILED_CATEGORIES 0xffffffffu
+#endif
+
+extern unsigned int log_mask;
+
+/*! \brief Records given event; a disabled category costs a single load and branch, a compiled out one nothing. */
+#define LogEvent(id, ...) do { \
+		if ((LOG_COMPILED_CATEGORIES & (1u << id##_CATEGORY)) && (__atomic_load_n(&log_mask, __ATOMIC_RELAXED) & (1u << id##_CATEGORY))) { \
+			WriteLogEvent(id, ##__VA_ARGS__); \
+		} \
+	} while (0)
+
+void StartLog(bool verbose);
+void WriteLogEvent(enum LogEventId id, ...);
+void FinishLog(void);
+
+#endif
@@ -37,22 +37,36 @@ int main(int argc, char** argv) {
 
 	srand(time(NULL));
 
+	StartAllocTracking();
+	StartTrace();
+
 	al_set_org_name("Super Derpy");
 	al_set_app_name(PRETTY_GAMENAME);
 
+	TraceBegin("libsuperderpy_init");
 	struct Game *game = libsuperderpy_init(argc, argv, GAMENAME, (struct libsuperderpy_viewport){320, 180});
+	TraceEnd("libsuperderpy_init");
 	if (!game) { return 1; }
 
 	al_set_window_title(game->display, PRETTY_GAMENAME);
 
-	LoadGamestate(game, "dosowisko");
-	StartGamestate(game, "dosowisko");
+	StartLog(game->config.debug);
 
+	TraceBegin("CreateGameData");
 	game->data = CreateGameData(game);
+	TraceEnd("CreateGameData");
+
+	LoadGamestate(game, "dosowisko");
+	StartGamestate(game, "dosowisko");
 
 	libsuperderpy_run(game);
+	FinishAllocTracking();
+	FinishTrace(); // in case the game was closed before the menu showed up
 
-	DestroyGameData(game, game->data);
+	// gamestates still loaded get unloaded by libsuperderpy_destroy,
+	// which is also when the common resources go away
+	CloseGameData(game);
+	FinishLog();
 
 	libsuperderpy_destroy(game);
 
@@ -0,0 +1,250 @@
+/*! \file palette.c
+ *  \brief Palette-indexed bitmaps resolved in a shader at draw time.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include <libsuperderpy.h>
+
+static const char *palette_pixel_shader =
+	"#ifdef GL_ES\n"
+	"precision mediump float;\n"
+	"#endif\n"
+	"uniform sampler2D al_tex;\n"
+	"uniform sampler2D palette_tex;\n"
+	"varying vec4 varying_color;\n"
+	"varying vec2 varying_texcoord;\n"
+	"void main() {\n"
+	"	float index = texture2D(al_tex, varying_texcoord).r * 255.0;\n"
+	"	gl_FragColor = texture2D(palette_tex, vec2((index + 0.5) / 256.0, 0.5)) * varying_color;\n"
+	"}\n";
+
+/*! \brief Builds the lookup shader; without a programmable pipeline indexed bitmaps get expanded on load instead. */
+void InitPalette(struct Game *game, struct Palette *palette) {
+	ALLEGRO_DISPLAY *display = al_get_current_display();
+	if (!display || !(al_get_display_flags(display) & ALLEGRO_PROGRAMMABLE_PIPELINE)) return;
+	ALLEGRO_SHADER *shader = al_create_shader(ALLEGRO_SHADER_GLSL);
+	if (!shader) return;
+	if (!al_attach_shader_source(shader, ALLEGRO_VERTEX_SHADER, al_get_default_shader_source(ALLEGRO_SHADER_GLSL, ALLEGRO_VERTEX_SHADER))
+	    || !al_attach_shader_source(shader, ALLEGRO_PIXEL_SHADER, palette_pixel_shader) || !al_build_shader(shader)) {
+		PrintConsole(game, "Can't build palette shader, indexed bitmaps will be expanded: %s", al_get_shader_log(shader));
+		al_destroy_shader(shader);
+		return;
+	}
+	palette->shader = shader;
+}
+
+void DestroyPalette(struct Palette *palette) {
+	if (palette->texture) al_destroy_bitmap(palette->texture);
+	if (palette->white) al_destroy_bitmap(palette->white);
+	if (palette->shader) al_destroy_shader(palette->shader);
+}
+
+static bool LoadPaletteColors(struct Game *game, struct Palette *palette) {
+	if (palette->loaded) return palette->count > 0;
+	palette->loaded = true;
+	if (!DataFileExists(game, PALETTE_FILENAME)) return false;
+	ALLEGRO_FILE *file = OpenDataFile(game, PALETTE_FILENAME);
+	if (!file) return false;
+	char magic[4];
+	int count = 0;
+	if ((al_fread(file, magic, 4) == 4) && !memcmp(magic, PALETTE_MAGIC, 4)) {
+		count = al_fread32le(file);
+	}
+	if ((count > 0) && (count <= PALETTE_SIZE) && (al_fread(file, palette->colors, count * 4) == (size_t)count * 4)) {
+		palette->count = count;
+	} else {
+		PrintConsole(game, "Palette file %s is invalid, ignoring.", PALETTE_FILENAME);
+	}
+	al_fclose(file);
+	return palette->count > 0;
+}
+
+/*! \brief Premultiplied color of given palette entry, as Allegro's blenders expect. */
+static void GetPaletteColor(struct Palette *palette, unsigned char index, unsigned char *dst) {
+	if (index >= palette->count) index = 0;
+	const unsigned char *c = palette->colors[index];
+	dst[0] = c[0] * c[3] / 255;
+	dst[1] = c[1] * c[3] / 255;
+	dst[2] = c[2] * c[3] / 255;
+	dst[3] = c[3];
+}
+
+static ALLEGRO_BITMAP* CreateIndexedBitmap(int width, int height, unsigned char *indices, struct Palette *palette, bool expand) {
+	int format = al_get_new_bitmap_format(), flags = al_get_new_bitmap_flags();
+	// indices can't be interpolated
+	al_set_new_bitmap_flags(flags & ~(ALLEGRO_MIN_LINEAR | ALLEGRO_MAG_LINEAR));
+	al_set_new_bitmap_format(expand ? ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE : ALLEGRO_PIXEL_FORMAT_SINGLE_CHANNEL_8);
+	ALLEGRO_BITMAP *bitmap = al_create_bitmap(width, height);
+	al_set_new_bitmap_format(format);
+	al_set_new_bitmap_flags(flags);
+	if (!bitmap) return NULL;
+
+	ALLEGRO_LOCKED_REGION *region = al_lock_bitmap(bitmap, al_get_bitmap_format(bitmap), ALLEGRO_LOCK_WRITEONLY);
+	if (!region) {
+		al_destroy_bitmap(bitmap);
+		return NULL;
+	}
+	int x, y;
+	for (y=0; y<height; y++) {
+		unsigned char *row = (unsigned char*)region->data + y * region->pitch;
+		if (expand) {
+			for (x=0; x<width; x++) {
+				GetPaletteColor(palette, indices[y * width + x], row + x * 4);
+			}
+		} else {
+			memcpy(row, indices + y * width, width);
+		}
+	}
+	al_unlock_bitmap(bitmap);
+	return bitmap;
+}
+
+/*! \brief Loads the indexed version of given PNG, if the build produced one.
+ *
+ * The result is an 8-bit index bitmap to be drawn with DrawPaletteBitmap, or
+ * an RGBA one when memory bitmaps are requested or shaders aren't available.
+ * Returns NULL when the PNG has to be decoded instead.
+ */
+ALLEGRO_BITMAP* DecodeIndexedBitmap(struct Game *game, char* path) {
+	if (!game->data) return NULL;
+	struct Palette *palette = &game->data->palette;
+	char name[255], filename[1024];
+	char *ext = strrchr(path, '.');
+	if (!ext || strcmp(ext, ".png")) return NULL;
+	snprintf(name, sizeof(name), "%.*s%s", (int)(ext - path), path, INDEXED_EXTENSION);
+	// in debug mode a loose PNG overrides indices packed in the archive, so edited files show up without repacking
+	if (game->config.debug && FindDataFile(game, path, filename, sizeof(filename)) && !FindDataFile(game, name, filename, sizeof(filename))) return NULL;
+	if (!DataFileExists(game, name) || !LoadPaletteColors(game, palette)) return NULL;
+
+	ALLEGRO_FILE *file = OpenDataFile(game, name);
+	if (!file) return NULL;
+	char magic[4];
+	int width = 0, height = 0;
+	if ((al_fread(file, magic, 4) == 4) && !memcmp(magic, INDEXED_MAGIC, 4)) {
+		width = al_fread32le(file);
+		height = al_fread32le(file);
+	}
+	if ((width <= 0) || (height <= 0)) {
+		al_fclose(file);
+		return NULL;
+	}
+	size_t size = (size_t)width * height;
+	unsigned char *indices = malloc(size);
+	bool ok = al_fread(file, indices, size) == size;
+	al_fclose(file);
+
+	ALLEGRO_BITMAP *bitmap = NULL;
+	if (ok) {
+		TraceBegin(name);
+		bool expand = !palette->shader || (al_get_new_bitmap_flags() & ALLEGRO_MEMORY_BITMAP);
+		bitmap = CreateIndexedBitmap(width, height, indices, palette, expand);
+		TraceEnd(name);
+	}
+	free(indices);
+	return bitmap;
+}
+
+/*! \brief Creates a lookup texture of the palette, with white set every color keeps only its alpha. */
+static ALLEGRO_BITMAP* CreatePaletteTexture(struct Palette *palette, bool white) {
+	int format = al_get_new_bitmap_format(), flags = al_get_new_bitmap_flags();
+	al_set_new_bitmap_flags(ALLEGRO_VIDEO_BITMAP);
+	al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE);
+	ALLEGRO_BITMAP *texture = al_create_bitmap(PALETTE_SIZE, 1);
+	al_set_new_bitmap_format(format);
+	al_set_new_bitmap_flags(flags);
+	if (!texture) return NULL;
+
+	ALLEGRO_LOCKED_REGION *region = al_lock_bitmap(texture, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+	if (!region) {
+		al_destroy_bitmap(texture);
+		return NULL;
+	}
+	int i;
+	for (i=0; i<PALETTE_SIZE; i++) {
+		unsigned char *dst = (unsigned char*)region->data + i * 4;
+		GetPaletteColor(palette, i, dst);
+		if (white) {
+			// premultiplied, so white is just the alpha everywhere
+			dst[0] = dst[1] = dst[2] = dst[3];
+		}
+	}
+	al_unlock_bitmap(texture);
+	return texture;
+}
+
+static void BindPaletteTexture(struct Palette *palette) {
+	al_set_shader_sampler("palette_tex", palette->flash ? palette->white : palette->texture, 1);
+}
+
+/*! \brief Gets the right shader in use for drawing the bitmap; returns whether it's indexed.
+ *
+ * Indexed bitmaps need the lookup shader, which then stays in use, so a run
+ * of indexed draws binds it only once. Others get Allegro's default shader
+ * back. Call FinishPaletteDrawing before drawing anything without this.
+ */
+bool UsePaletteShader(struct Game *game, ALLEGRO_BITMAP *bitmap) {
+	if (!game->data) return false;
+	if (al_get_bitmap_format(bitmap) != ALLEGRO_PIXEL_FORMAT_SINGLE_CHANNEL_8) {
+		FinishPaletteDrawing(game);
+		return false;
+	}
+	struct Palette *palette = &game->data->palette;
+	if (palette->bound) return true;
+	if (!palette->texture) {
+		palette->texture = CreatePaletteTexture(palette, false);
+		palette->white = CreatePaletteTexture(palette, true);
+		if (!palette->texture || !palette->white) return false;
+	}
+	al_use_shader(palette->shader);
+	BindPaletteTexture(palette);
+	palette->bound = true;
+	return true;
+}
+
+/*! \brief Goes back to Allegro's default shader after a run of indexed draws. */
+void FinishPaletteDrawing(struct Game *game) {
+	if (!game->data || !game->data->palette.bound) return;
+	al_use_shader(NULL);
+	game->data->palette.bound = false;
+}
+
+/*! \brief Makes indexed bitmaps draw all white, or normal again.
+ *
+ * Returns false when the swap can't show, as bitmaps are expanded to RGBA or
+ * composited on the CPU instead of going through the lookup shader.
+ */
+bool SetPaletteFlash(struct Game *game, bool flash) {
+	if (!game->data) return false;
+	struct Palette *palette = &game->data->palette;
+	if (!palette->shader || !palette->count || game->data->compositor) return false;
+	palette->flash = flash;
+	if (palette->bound) BindPaletteTexture(palette);
+	return true;
+}
+
+/*! \brief Same as al_draw_tinted_bitmap, but also handles indexed bitmaps; see UsePaletteShader. */
+void DrawPaletteBitmap(struct Game *game, ALLEGRO_BITMAP *bitmap, ALLEGRO_COLOR tint, float x, float y, int flags) {
+	if (IsCompositing(game)) {
+		CompositeBitmap(game, bitmap, tint, x, y, flags);
+		return;
+	}
+	UsePaletteShader(game, bitmap);
+	al_draw_tinted_bitmap(bitmap, tint, x, y, flags);
+}
@@ -0,0 +1,47 @@
+#ifndef RADIOEDIT_PALETTE_H
+#define RADIOEDIT_PALETTE_H
+
+#include <stdint.h>
+
+#define PALETTE_MAGIC "RPAL"
+#define PALETTE_FILENAME "palette.pal"
+#define PALETTE_SIZE 256
+#define INDEXED_MAGIC "RIDX"
+#define INDEXED_EXTENSION ".idx"
+
+/* Shared palette file: magic, little endian uint32 color count, then four bytes
+ * (RGBA, not premultiplied) per color. Color 0 is always fully transparent.
+ *
+ * Indexed image file: magic, little endian uint32 width and height, then one
+ * palette index per pixel, row by row. Zero size marks an image which didn't fit
+ * into the shared palette and has to be loaded from its PNG. */
+
+#ifndef RADIOEDIT_PALETTE_TOOL
+
+#include <allegro5/allegro.h>
+
+struct Game;
+
+/*! \brief Shared palette of the pixel-art assets. */
+struct Palette {
+	unsigned char colors[PALETTE_SIZE][4];
+	int count; /*!< 0 when there's no palette file, so bitmaps are decoded from PNGs. */
+	bool loaded; /*!< Read lazily, as the data archive isn't available yet when game data is created. */
+	ALLEGRO_SHADER *shader; /*!< Index lookup shader, NULL when indices have to be expanded on the CPU. */
+	ALLEGRO_BITMAP *texture; /*!< PALETTE_SIZE x 1 lookup texture, created on first draw. */
+	ALLEGRO_BITMAP *white; /*!< The same lookup with every color turned white, for flashes. */
+	bool flash; /*!< Indexed bitmaps are drawn with the white lookup. */
+	bool bound; /*!< The lookup shader is in use, kept over a run of indexed draws. */
+};
+
+void InitPalette(struct Game *game, struct Palette *palette);
+void DestroyPalette(struct Palette *palette);
+ALLEGRO_BITMAP* DecodeIndexedBitmap(struct Game *game, char* path);
+bool UsePaletteShader(struct Game *game, ALLEGRO_BITMAP *bitmap);
+void FinishPaletteDrawing(struct Game *game);
+bool SetPaletteFlash(struct Game *game, bool flash);
+void DrawPaletteBitmap(struct Game *game, ALLEGRO_BITMAP *bitmap, ALLEGRO_COLOR tint, float x, float y, int flags);
+
+#endif
+
+#endif
@@ -0,0 +1,260 @@
+/*! \file particles.c
+ *  \brief Pooled particles of melting badguys, chords and solo blasts.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include <libsuperderpy.h>
+#include <math.h>
+#include <stddef.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PARTICLES_AVX
+#endif
+
+static void StepScalar(struct ParticlePool *pool, int count) {
+	int i;
+	for (i=0; i<count; i++) {
+		pool->vx[i] *= PARTICLE_DRAG;
+		pool->vy[i] = pool->vy[i] * PARTICLE_DRAG + PARTICLE_GRAVITY;
+		pool->x[i] += pool->vx[i];
+		pool->y[i] += pool->vy[i];
+		pool->life[i] -= 1;
+	}
+}
+
+#ifdef __SSE2__
+static void StepSSE2(struct ParticlePool *pool, int count) {
+	const __m128 drag = _mm_set1_ps(PARTICLE_DRAG), gravity = _mm_set1_ps(PARTICLE_GRAVITY), one = _mm_set1_ps(1);
+	int i;
+	for (i=0; i<count; i+=4) {
+		__m128 vx = _mm_mul_ps(_mm_load_ps(pool->vx + i), drag);
+		__m128 vy = _mm_add_ps(_mm_mul_ps(_mm_load_ps(pool->vy + i), drag), gravity);
+		_mm_store_ps(pool->vx + i, vx);
+		_mm_store_ps(pool->vy + i, vy);
+		_mm_store_ps(pool->x + i, _mm_add_ps(_mm_load_ps(pool->x + i), vx));
+		_mm_store_ps(pool->y + i, _mm_add_ps(_mm_load_ps(pool->y + i), vy));
+		_mm_store_ps(pool->life + i, _mm_sub_ps(_mm_load_ps(pool->life + i), one));
+	}
+}
+#endif
+
+#ifdef PARTICLES_AVX
+__attribute__((target("avx"))) static void StepAVX(struct ParticlePool *pool, int count) {
+	const __m256 drag = _mm256_set1_ps(PARTICLE_DRAG), gravity = _mm256_set1_ps(PARTICLE_GRAVITY), one = _mm256_set1_ps(1);
+	int i;
+	for (i=0; i<count; i+=8) {
+		__m256 vx = _mm256_mul_ps(_mm256_load_ps(pool->vx + i), drag);
+		__m256 vy = _mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(pool->vy + i), drag), gravity);
+		_mm256_store_ps(pool->vx + i, vx);
+		_mm256_store_ps(pool->vy + i, vy);
+		_mm256_store_ps(pool->x + i, _mm256_add_ps(_mm256_load_ps(pool->x + i), vx));
+		_mm256_store_ps(pool->y + i, _mm256_add_ps(_mm256_load_ps(pool->y + i), vy));
+		_mm256_store_ps(pool->life + i, _mm256_sub_ps(_mm256_load_ps(pool->life + i), one));
+	}
+}
+#endif
+
+static float* AllocateAttribute(void) {
+	void *array = NULL;
+	if (posix_memalign(&array, 32, PARTICLE_CAPACITY * sizeof(float))) return NULL;
+	memset(array, 0, PARTICLE_CAPACITY * sizeof(float));
+	return array;
+}
+
+struct ParticlePool* CreateParticlePool(struct Game *game) {
+	struct ParticlePool *pool = calloc(1, sizeof(struct ParticlePool));
+	pool->width = game->viewport.width;
+	pool->height = game->viewport.height;
+	pool->x = AllocateAttribute();
+	pool->y = AllocateAttribute();
+	pool->vx = AllocateAttribute();
+	pool->vy = AllocateAttribute();
+	pool->life = AllocateAttribute();
+	pool->fade = AllocateAttribute();
+	pool->tint = calloc(PARTICLE_CAPACITY, sizeof(uint8_t));
+	SeedRandom(&pool->random, 0x9a7f1c1e);
+
+	pool->vertices = malloc(PARTICLE_CAPACITY * 4 * sizeof(struct ParticleVertex));
+	pool->indices = malloc(PARTICLE_CAPACITY * 6 * sizeof(int));
+	int i;
+	for (i=0; i<PARTICLE_CAPACITY; i++) {
+		int *quad = pool->indices + i * 6, corner = i * 4;
+		quad[0] = corner;
+		quad[1] = corner + 1;
+		quad[2] = corner + 2;
+		quad[3] = corner + 2;
+		quad[4] = corner + 1;
+		quad[5] = corner + 3;
+	}
+	ALLEGRO_VERTEX_ELEMENT elements[] = {
+		{ ALLEGRO_PRIM_POSITION, ALLEGRO_PRIM_FLOAT_2, offsetof(struct ParticleVertex, x) },
+		{ ALLEGRO_PRIM_COLOR_ATTR, 0, offsetof(struct ParticleVertex, color) },
+		{ 0, 0, 0 }
+	};
+	pool->decl = al_create_vertex_decl(elements, sizeof(struct ParticleVertex));
+
+	pool->step = StepScalar;
+#ifdef __SSE2__
+	pool->step = StepSSE2;
+#endif
+#ifdef PARTICLES_AVX
+	if (__builtin_cpu_supports("avx")) {
+		pool->step = StepAVX;
+	}
+#endif
+	return pool;
+}
+
+void DestroyParticlePool(struct ParticlePool *pool) {
+	if (!pool) return;
+	al_destroy_vertex_decl(pool->decl);
+	free(pool->indices);
+	free(pool->vertices);
+	free(pool->tint);
+	free(pool->fade);
+	free(pool->life);
+	free(pool->vy);
+	free(pool->vx);
+	free(pool->y);
+	free(pool->x);
+	free(pool);
+}
+
+void ClearParticles(struct ParticlePool *pool) {
+	pool->count = 0;
+	pool->tint_count = 0;
+}
+
+static int FindTint(struct ParticlePool *pool, ALLEGRO_COLOR color) {
+	int i;
+	for (i=0; i<pool->tint_count; i++) {
+		ALLEGRO_COLOR *tint = &pool->tints[i];
+		if ((tint->r == color.r) && (tint->g == color.g) && (tint->b == color.b) && (tint->a == color.a)) return i;
+	}
+	if (pool->tint_count == PARTICLE_TINTS) {
+		// the colors only ever come from a few call sites, so this is hardly reached
+		return PARTICLE_TINTS - 1;
+	}
+	pool->tints[pool->tint_count] = color;
+	return pool->tint_count++;
+}
+
+static float RandomFloat(struct Random *random) {
+	return (NextRandom(random) >> 8) * (1.0f / 16777216);
+}
+
+/*! \brief Spawns particles in given rectangle, flying at up to speed in directions within spread of angle.
+ *
+ * Each one lives between half and all of life ticks. Particles that don't
+ * fit into the pool are dropped.
+ */
+void EmitParticles(struct ParticlePool *pool, int count, float x, float y, float w, float h, float speed, float angle, float spread, ALLEGRO_COLOR color, int life) {
+	if (count > PARTICLE_CAPACITY - pool->count) count = PARTICLE_CAPACITY - pool->count;
+	if (count <= 0) return;
+	uint8_t tint = FindTint(pool, color);
+	int i;
+	for (i=pool->count; i<pool->count+count; i++) {
+		float direction = angle + (RandomFloat(&pool->random) - 0.5f) * spread;
+		float velocity = speed * (0.25f + 0.75f * RandomFloat(&pool->random));
+		float ticks = life * (0.5f + 0.5f * RandomFloat(&pool->random));
+		pool->x[i] = x + w * RandomFloat(&pool->random);
+		pool->y[i] = y + h * RandomFloat(&pool->random);
+		pool->vx[i] = cosf(direction) * velocity;
+		pool->vy[i] = sinf(direction) * velocity;
+		pool->life[i] = ticks;
+		pool->fade[i] = 1 / ticks;
+		pool->tint[i] = tint;
+	}
+	pool->count += count;
+}
+
+/*! \brief Moves particles by one tick and removes the ones that died or left the screen. */
+void UpdateParticles(struct ParticlePool *pool) {
+	if (!pool->count) {
+		pool->tint_count = 0;
+		return;
+	}
+	// slots past count hold dead particles, moving them too saves the kernels a tail
+	pool->step(pool, (pool->count + 7) & ~7);
+
+	int i = 0;
+	while (i < pool->count) {
+		if ((pool->life[i] > 0) && (pool->x[i] > -1) && (pool->x[i] < pool->width) && (pool->y[i] < pool->height)) {
+			i++;
+			continue;
+		}
+		int last = --pool->count;
+		pool->x[i] = pool->x[last];
+		pool->y[i] = pool->y[last];
+		pool->vx[i] = pool->vx[last];
+		pool->vy[i] = pool->vy[last];
+		pool->life[i] = pool->life[last];
+		pool->fade[i] = pool->fade[last];
+		pool->tint[i] = pool->tint[last];
+	}
+}
+
+static void CompositeParticles(struct Game *game, struct ParticlePool *pool) {
+	struct Compositor *compositor = game->data->compositor;
+	int i, c;
+	for (i=0; i<pool->count; i++) {
+		int x = pool->x[i], y = pool->y[i];
+		if ((y < 0) || (x >= compositor->width) || (y >= compositor->height)) continue;
+		ALLEGRO_COLOR *tint = &pool->tints[pool->tint[i]];
+		float scale = pool->life[i] * pool->fade[i] * tint->a * 255;
+		uint32_t add = ((uint32_t)(scale) << 24) | ((uint32_t)(tint->r * scale) << 16) | ((uint32_t)(tint->g * scale) << 8) | (uint32_t)(tint->b * scale);
+		uint32_t *pixel = &compositor->frame[y * compositor->width + x], result = 0;
+		for (c=0; c<4; c++) {
+			uint32_t v = ((*pixel >> (c * 8)) & 0xff) + ((add >> (c * 8)) & 0xff);
+			result |= (v > 255 ? 255 : v) << (c * 8);
+		}
+		*pixel = result;
+	}
+}
+
+/*! \brief Draws all particles, adding their light to what's already drawn, with a single draw call. */
+void DrawParticles(struct Game *game, struct ParticlePool *pool) {
+	if (!pool->count) return;
+	if (IsCompositing(game)) {
+		CompositeParticles(game, pool);
+		return;
+	}
+	int i;
+	for (i=0; i<pool->count; i++) {
+		ALLEGRO_COLOR *tint = &pool->tints[pool->tint[i]];
+		float alpha = pool->life[i] * pool->fade[i] * tint->a;
+		ALLEGRO_COLOR color = {tint->r * alpha, tint->g * alpha, tint->b * alpha, alpha};
+		// snapped to whole pixels like the rest of the pixel art
+		float x = (int)pool->x[i], y = (int)pool->y[i];
+		struct ParticleVertex *quad = pool->vertices + i * 4;
+		quad[0] = (struct ParticleVertex){x, y, color};
+		quad[1] = (struct ParticleVertex){x + 1, y, color};
+		quad[2] = (struct ParticleVertex){x, y + 1, color};
+		quad[3] = (struct ParticleVertex){x + 1, y + 1, color};
+	}
+	int op, src, dst;
+	al_get_blender(&op, &src, &dst);
+	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ONE);
+	al_draw_indexed_prim(pool->vertices, pool->decl, NULL, pool->indices, pool->count * 6, ALLEGRO_PRIM_TRIANGLE_LIST);
+	al_set_blender(op, src, dst);
+}
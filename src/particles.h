@@ -0,0 +1,55 @@
+#ifndef RADIOEDIT_PARTICLES_H
+#define RADIOEDIT_PARTICLES_H
+
+#include <stdint.h>
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_primitives.h>
+#include "random.h"
+
+struct Game;
+struct ParticlePool;
+
+#define PARTICLE_CAPACITY 32768 /*!< Particles alive at once; a multiple of 8, so kernels need no tail. */
+#define PARTICLE_TINTS 16 /*!< Distinct colors of particles alive at once. */
+#define PARTICLE_GRAVITY 0.03f /*!< Pixels per tick added to the vertical speed. */
+#define PARTICLE_DRAG 0.97f /*!< Speed kept from one tick to the next. */
+
+/*! \brief Moves the first count particles by one tick. */
+typedef void (*ParticleStep)(struct ParticlePool *pool, int count);
+
+/*! \brief Corner of a particle's quad as drawn by the GPU. */
+struct ParticleVertex {
+	float x, y;
+	ALLEGRO_COLOR color;
+};
+
+/*! \brief Fixed-capacity pool of one-pixel particles, drawn additively over the scene.
+ *
+ * Particles are stored as separate arrays of each attribute so that the
+ * movement is done several particles at a time. Dead particles are replaced
+ * by the last live one, keeping the live ones packed at the start.
+ */
+struct ParticlePool {
+	int count; /*!< Live particles. */
+	int width, height; /*!< Particles leaving this area die. */
+	float *x, *y, *vx, *vy;
+	float *life; /*!< Ticks left to live. */
+	float *fade; /*!< Inverse of the starting life, so brightness is life * fade. */
+	uint8_t *tint; /*!< Index into tints. */
+	ALLEGRO_COLOR tints[PARTICLE_TINTS];
+	int tint_count;
+	struct Random random; /*!< Kept apart from gameplay randomness, as particles aren't in snapshots. */
+	ParticleStep step;
+	struct ParticleVertex *vertices; /*!< Four per particle. */
+	int *indices; /*!< Two triangles per particle, filled once. */
+	ALLEGRO_VERTEX_DECL *decl;
+};
+
+struct ParticlePool* CreateParticlePool(struct Game *game);
+void DestroyParticlePool(struct ParticlePool *pool);
+void ClearParticles(struct ParticlePool *pool);
+void EmitParticles(struct ParticlePool *pool, int count, float x, float y, float w, float h, float speed, float angle, float spread, ALLEGRO_COLOR color, int life);
+void UpdateParticles(struct ParticlePool *pool);
+void DrawParticles(struct Game *game, struct ParticlePool *pool);
+
+#endif
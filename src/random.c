@@ -0,0 +1,41 @@
+/*! \file random.c
+ *  \brief Deterministic random numbers for gameplay.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "random.h"
+
+void SeedRandom(struct Random *random, uint32_t seed) {
+	// zero is the one state xorshift never leaves
+	random->state = seed ? seed : 0x9e3779b9;
+}
+
+uint32_t NextRandom(struct Random *random) {
+	uint32_t x = random->state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	random->state = x;
+	return x;
+}
+
+/*! \brief Random number from 0 to n-1, a drop-in for rand() % n. */
+int RandomInt(struct Random *random, int n) {
+	return NextRandom(random) % n;
+}
@@ -0,0 +1,15 @@
+#ifndef RADIOEDIT_RANDOM_H
+#define RADIOEDIT_RANDOM_H
+
+#include <stdint.h>
+
+/*! \brief Xorshift generator; its whole state fits into snapshots, unlike rand()'s. */
+struct Random {
+	uint32_t state;
+};
+
+void SeedRandom(struct Random *random, uint32_t seed);
+uint32_t NextRandom(struct Random *random);
+int RandomInt(struct Random *random, int n);
+
+#endif
@@ -0,0 +1,308 @@
+/*! \file schedule.c
+ *  \brief Timeline of gamestate actions backed by fixed pools.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Time is counted by ProcessSchedule itself instead of by Allegro timers, so
+// there's nothing to hand over through the event queue and pausing is just
+// not counting. It counts logic ticks rather than wall time: ticks are what
+// the gamestates' animations and audio positions advance by, so delays don't
+// stretch or shrink when frames are slow, skipped or caught up on.
+
+#include <stdarg.h>
+#include "common.h"
+#include <libsuperderpy.h>
+
+static void AppendAction(struct ScheduleList *list, struct ScheduledAction *action) {
+	action->next = NULL;
+	if (list->last) {
+		list->last->next = action;
+	} else {
+		list->first = action;
+	}
+	list->last = action;
+}
+
+static void UnlinkAction(struct ScheduleList *list, struct ScheduledAction *prev, struct ScheduledAction *action) {
+	if (prev) {
+		prev->next = action->next;
+	} else {
+		list->first = action->next;
+	}
+	if (list->last == action) list->last = prev;
+}
+
+static void ReleaseAction(struct Schedule *schedule, struct ScheduledAction *action) {
+	action->next = schedule->free;
+	schedule->free = action;
+}
+
+/*! \brief Gives the whole list back to the pool at once. */
+static void ReleaseList(struct Schedule *schedule, struct ScheduleList *list) {
+	if (list->first) {
+		list->last->next = schedule->free;
+		schedule->free = list->first;
+	}
+	list->first = NULL;
+	list->last = NULL;
+}
+
+struct Schedule* CreateSchedule(struct Game *game, char *name) {
+	struct Schedule *schedule = calloc(1, sizeof(struct Schedule));
+	schedule->game = game;
+	schedule->name = name;
+	// libsuperderpy calls Logic once per event of its timer, so the timer speed is the tick length
+	schedule->tick = al_get_timer_speed(game->_priv.timer) * 1000;
+	schedule->actions = calloc(SCHEDULE_CAPACITY, sizeof(struct ScheduledAction));
+	schedule->arg_nodes = calloc(SCHEDULE_ARG_NODES, sizeof(struct ScheduleArgs));
+	int i;
+	for (i=SCHEDULE_CAPACITY-1; i>=0; i--) {
+		schedule->actions[i].schedule = schedule;
+		ReleaseAction(schedule, &schedule->actions[i]);
+	}
+	for (i=SCHEDULE_ARG_NODES-1; i>=0; i--) {
+		schedule->arg_nodes[i].next = schedule->free_args;
+		schedule->free_args = &schedule->arg_nodes[i];
+	}
+	return schedule;
+}
+
+/*! \brief Clears the schedule, so started actions get their DESTROY, and frees it. */
+void DestroySchedule(struct Schedule *schedule) {
+	ClearSchedule(schedule);
+	free(schedule->arg_nodes);
+	free(schedule->actions);
+	free(schedule);
+}
+
+/*! \brief Drops everything scheduled; only the queue's head and running background actions are visited, for their DESTROY. */
+void ClearSchedule(struct Schedule *schedule) {
+	struct ScheduledAction *action = schedule->queue.first;
+	if (action && action->started && (action->kind == SCHEDULE_KIND_ACTION)) {
+		action->function(schedule->game, action, SCHEDULE_DESTROY);
+	}
+	for (action = schedule->running.first; action; action = action->next) {
+		action->function(schedule->game, action, SCHEDULE_DESTROY);
+	}
+	ReleaseList(schedule, &schedule->queue);
+	ReleaseList(schedule, &schedule->waiting);
+	ReleaseList(schedule, &schedule->running);
+}
+
+/*! \brief Makes the action's argument nodes fit argc arguments, taking from or returning to the pool. */
+static bool FitArgs(struct Schedule *schedule, struct ScheduledAction *action, int argc) {
+	int needed = argc > SCHEDULE_INLINE_ARGS ? (argc - 1) / SCHEDULE_INLINE_ARGS : 0;
+	struct ScheduleArgs **link = &action->more;
+	int i;
+	for (i=0; i<needed; i++) {
+		if (!*link) {
+			if (!schedule->free_args) return false;
+			*link = schedule->free_args;
+			schedule->free_args = (*link)->next;
+			(*link)->next = NULL;
+		}
+		link = &(*link)->next;
+	}
+	while (*link) {
+		struct ScheduleArgs *node = *link;
+		*link = node->next;
+		node->next = schedule->free_args;
+		schedule->free_args = node;
+	}
+	return true;
+}
+
+static struct ScheduledAction* TakeAction(struct Schedule *schedule, enum ScheduleKind kind, ScheduleFunction function, double delay, char *name, int argc) {
+	struct ScheduledAction *action = schedule->free;
+	if (!action || !FitArgs(schedule, action, argc)) {
+		PrintConsole(schedule->game, "Schedule %s: no room left for %s.", schedule->name, name);
+		return NULL;
+	}
+	schedule->free = action->next;
+	action->kind = kind;
+	action->function = function;
+	action->name = name;
+	action->argc = argc;
+	action->delay = delay;
+	action->due = 0;
+	action->repeat = -1;
+	action->started = false;
+	return action;
+}
+
+static void StoreArgs(struct ScheduledAction *action, va_list ap) {
+	struct ScheduleArgs *node = action->more;
+	int i;
+	for (i=0; i<action->argc; i++) {
+		void *value = va_arg(ap, void*);
+		if (i < SCHEDULE_INLINE_ARGS) {
+			action->args[i] = value;
+			continue;
+		}
+		int slot = (i - SCHEDULE_INLINE_ARGS) % SCHEDULE_INLINE_ARGS;
+		if ((slot == 0) && (i > SCHEDULE_INLINE_ARGS)) node = node->next;
+		node->values[slot] = value;
+	}
+}
+
+/*! \brief Queues an action to run once everything queued before it is done. */
+struct ScheduledAction* ScheduleAction(struct Schedule *schedule, ScheduleFunction function, char *name, int argc, ...) {
+	struct ScheduledAction *action = TakeAction(schedule, SCHEDULE_KIND_ACTION, function, 0, name, argc);
+	if (!action) return NULL;
+	va_list ap;
+	va_start(ap, argc);
+	StoreArgs(action, ap);
+	va_end(ap);
+	AppendAction(&schedule->queue, action);
+	return action;
+}
+
+/*! \brief Queues a pause of given milliseconds. */
+struct ScheduledAction* ScheduleDelay(struct Schedule *schedule, double delay) {
+	struct ScheduledAction *action = TakeAction(schedule, SCHEDULE_KIND_DELAY, NULL, delay, "delay", 0);
+	if (action) AppendAction(&schedule->queue, action);
+	return action;
+}
+
+/*! \brief Starts an action in the background after given milliseconds, regardless of the queue. */
+struct ScheduledAction* ScheduleBackground(struct Schedule *schedule, ScheduleFunction function, double delay, char *name, int argc, ...) {
+	struct ScheduledAction *action = TakeAction(schedule, SCHEDULE_KIND_ACTION, function, delay, name, argc);
+	if (!action) return NULL;
+	va_list ap;
+	va_start(ap, argc);
+	StoreArgs(action, ap);
+	va_end(ap);
+	action->due = schedule->time + delay;
+	AppendAction(&schedule->waiting, action);
+	return action;
+}
+
+/*! \brief Queues an action which goes to the background once reached, starting after given milliseconds. */
+struct ScheduledAction* ScheduleQueuedBackground(struct Schedule *schedule, ScheduleFunction function, double delay, char *name, int argc, ...) {
+	struct ScheduledAction *action = TakeAction(schedule, SCHEDULE_KIND_SPAWN, function, delay, name, argc);
+	if (!action) return NULL;
+	va_list ap;
+	va_start(ap, argc);
+	StoreArgs(action, ap);
+	va_end(ap);
+	AppendAction(&schedule->queue, action);
+	return action;
+}
+
+/*! \brief Makes a background action run again given milliseconds after it finishes, reusing its node and arguments.
+ *
+ * Meant to be called by the action itself; it gets its DESTROY and then a
+ * new START, like a fresh action would.
+ */
+void RepeatAction(struct ScheduledAction *action, double delay) {
+	action->repeat = delay;
+}
+
+void* GetScheduleArg(struct ScheduledAction *action, int i) {
+	if ((i < 0) || (i >= action->argc)) return NULL;
+	if (i < SCHEDULE_INLINE_ARGS) return action->args[i];
+	i -= SCHEDULE_INLINE_ARGS;
+	struct ScheduleArgs *node = action->more;
+	while (i >= SCHEDULE_INLINE_ARGS) {
+		node = node->next;
+		i -= SCHEDULE_INLINE_ARGS;
+	}
+	return node->values[i];
+}
+
+static void ProcessQueue(struct Schedule *schedule) {
+	struct ScheduledAction *action;
+	while ((action = schedule->queue.first)) {
+		if (!action->started) {
+			action->started = true;
+			action->due = schedule->time + action->delay;
+			if (action->kind == SCHEDULE_KIND_ACTION) {
+				action->function(schedule->game, action, SCHEDULE_START);
+			}
+		}
+		if (action->kind == SCHEDULE_KIND_DELAY) {
+			if (schedule->time < action->due) return;
+		} else if (action->kind == SCHEDULE_KIND_ACTION) {
+			if (!action->function(schedule->game, action, SCHEDULE_RUNNING)) return;
+			action->function(schedule->game, action, SCHEDULE_DESTROY);
+		}
+		UnlinkAction(&schedule->queue, NULL, action);
+		if (action->kind == SCHEDULE_KIND_SPAWN) {
+			action->kind = SCHEDULE_KIND_ACTION;
+			action->started = false;
+			AppendAction(&schedule->waiting, action);
+		} else {
+			ReleaseAction(schedule, action);
+		}
+	}
+}
+
+static void ProcessBackground(struct Schedule *schedule) {
+	struct ScheduledAction *action = schedule->waiting.first, *prev = NULL, *next;
+	while (action) {
+		next = action->next;
+		if (schedule->time >= action->due) {
+			UnlinkAction(&schedule->waiting, prev, action);
+			AppendAction(&schedule->running, action);
+			action->started = true;
+			action->function(schedule->game, action, SCHEDULE_START);
+		} else {
+			prev = action;
+		}
+		action = next;
+	}
+
+	action = schedule->running.first;
+	prev = NULL;
+	while (action) {
+		if (!action->function(schedule->game, action, SCHEDULE_RUNNING)) {
+			prev = action;
+			action = action->next;
+			continue;
+		}
+		action->function(schedule->game, action, SCHEDULE_DESTROY);
+		next = action->next;
+		UnlinkAction(&schedule->running, prev, action);
+		if (action->repeat >= 0) {
+			action->started = false;
+			action->due = schedule->time + action->repeat;
+			action->repeat = -1;
+			AppendAction(&schedule->waiting, action);
+		} else {
+			ReleaseAction(schedule, action);
+		}
+		action = next;
+	}
+}
+
+/*! \brief Moves time forward by a tick and runs whatever is due; call once per tick. */
+void ProcessSchedule(struct Schedule *schedule) {
+	if (schedule->paused) return;
+	schedule->time += schedule->tick;
+	ProcessQueue(schedule);
+	ProcessBackground(schedule);
+}
+
+void PauseSchedule(struct Schedule *schedule) {
+	schedule->paused = true;
+}
+
+void ResumeSchedule(struct Schedule *schedule) {
+	schedule->paused = false;
+}
@@ -0,0 +1,90 @@
+#ifndef RADIOEDIT_SCHEDULE_H
+#define RADIOEDIT_SCHEDULE_H
+
+#include <stdbool.h>
+
+struct Game;
+struct ScheduledAction;
+
+#define SCHEDULE_CAPACITY 32 /*!< Actions and delays pending at once in one schedule. */
+#define SCHEDULE_INLINE_ARGS 4 /*!< Arguments stored in the action itself; more take argument nodes. */
+#define SCHEDULE_ARG_NODES 8 /*!< Argument nodes of one schedule, each holding SCHEDULE_INLINE_ARGS more arguments. */
+
+enum ScheduleState {
+	SCHEDULE_START, /*!< The action is about to run for the first time. */
+	SCHEDULE_RUNNING, /*!< Called once per tick until the action returns true. */
+	SCHEDULE_DESTROY /*!< The action finished or was cleared after it started. */
+};
+
+/*! \brief Action callback; its return value matters only while running, where true means it's done. */
+typedef bool (*ScheduleFunction)(struct Game *game, struct ScheduledAction *action, enum ScheduleState state);
+
+enum ScheduleKind {
+	SCHEDULE_KIND_ACTION,
+	SCHEDULE_KIND_DELAY, /*!< Holds the queue for a while. */
+	SCHEDULE_KIND_SPAWN /*!< Moves its action to the background once it's reached in the queue. */
+};
+
+struct ScheduleArgs {
+	void *values[SCHEDULE_INLINE_ARGS];
+	struct ScheduleArgs *next;
+};
+
+/*! \brief Pooled action or delay; never freed, only returned to the schedule's free list. */
+struct ScheduledAction {
+	enum ScheduleKind kind;
+	ScheduleFunction function;
+	char *name; /*!< Not copied, so it has to outlive the action. */
+	struct Schedule *schedule;
+	void *args[SCHEDULE_INLINE_ARGS];
+	int argc;
+	struct ScheduleArgs *more; /*!< Arguments past the inline ones; kept while on the free list and reused or trimmed by the next user. */
+	double delay; /*!< Milliseconds to wait, counted from when the action is reached or goes to the background. */
+	double due; /*!< Schedule time at which a background action starts. */
+	double repeat; /*!< Delay after which a finished background action runs again, negative for none. */
+	bool started;
+	struct ScheduledAction *next;
+};
+
+struct ScheduleList {
+	struct ScheduledAction *first, *last;
+};
+
+/*! \brief Replacement of libsuperderpy's timeline for the gamestates, which never allocates after creation.
+ *
+ * Like the timeline it has a queue of actions and delays run one after
+ * another, and background actions run next to it. Actions, delays and their
+ * arguments come from pools allocated up front. A finished background action
+ * can be rescheduled in place with RepeatAction, and clearing only splices
+ * lists back into the pool, calling DESTROY on the few actions that started.
+ * Callbacks may add actions, but mustn't clear or destroy the schedule.
+ */
+struct Schedule {
+	struct Game *game;
+	char *name;
+	struct ScheduledAction *actions;
+	struct ScheduleArgs *arg_nodes;
+	struct ScheduledAction *free;
+	struct ScheduleArgs *free_args;
+	struct ScheduleList queue;
+	struct ScheduleList waiting; /*!< Background actions before their delay passed. */
+	struct ScheduleList running; /*!< Background actions which started. */
+	double time; /*!< Milliseconds counted by ProcessSchedule, one tick per call. */
+	double tick; /*!< Milliseconds one ProcessSchedule call moves time by, from libsuperderpy's logic timer. */
+	bool paused;
+};
+
+struct Schedule* CreateSchedule(struct Game *game, char *name);
+void DestroySchedule(struct Schedule *schedule);
+void ProcessSchedule(struct Schedule *schedule);
+void PauseSchedule(struct Schedule *schedule);
+void ResumeSchedule(struct Schedule *schedule);
+void ClearSchedule(struct Schedule *schedule);
+struct ScheduledAction* ScheduleAction(struct Schedule *schedule, ScheduleFunction function, char *name, int argc, ...);
+struct ScheduledAction* ScheduleDelay(struct Schedule *schedule, double delay);
+struct ScheduledAction* ScheduleBackground(struct Schedule *schedule, ScheduleFunction function, double delay, char *name, int argc, ...);
+struct ScheduledAction* ScheduleQueuedBackground(struct Schedule *schedule, ScheduleFunction function, double delay, char *name, int argc, ...);
+void RepeatAction(struct ScheduledAction *action, double delay);
+void* GetScheduleArg(struct ScheduledAction *action, int i);
+
+#endif
@@ -0,0 +1,101 @@
+/*! \file snapshot.c
+ *  \brief Ring buffer of serialized gameplay states.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "snapshot.h"
+#include <stdlib.h>
+
+void InitSnapshotRing(struct SnapshotRing *ring) {
+	ring->data = malloc(SNAPSHOT_BYTES);
+	ring->entries = malloc(SNAPSHOT_COUNT * sizeof(struct SnapshotEntry));
+	ClearSnapshots(ring);
+}
+
+void DestroySnapshotRing(struct SnapshotRing *ring) {
+	free(ring->data);
+	free(ring->entries);
+	ring->data = NULL;
+	ring->entries = NULL;
+}
+
+void ClearSnapshots(struct SnapshotRing *ring) {
+	ring->head = 0;
+	ring->first = 0;
+	ring->count = 0;
+}
+
+/*! \brief Reserves room for a new snapshot and returns where to write it, NULL when it's too big for the ring. */
+unsigned char* PushSnapshot(struct SnapshotRing *ring, uint32_t tick, size_t length) {
+	if (!ring->data || (length > SNAPSHOT_BYTES)) return NULL;
+	if (ring->head + length > SNAPSHOT_BYTES) {
+		// whatever lies past the current position is left from the previous lap, so it's the oldest
+		while (ring->count && (ring->entries[ring->first].offset >= ring->head)) {
+			ring->first = (ring->first + 1) % SNAPSHOT_COUNT;
+			ring->count--;
+		}
+		ring->head = 0;
+	}
+	// snapshots are written in order, so the ones in the way are always the oldest
+	while (ring->count) {
+		struct SnapshotEntry *oldest = &ring->entries[ring->first];
+		bool overlaps = (oldest->offset < ring->head + length) && (ring->head < oldest->offset + oldest->length);
+		if (!overlaps && (ring->count < SNAPSHOT_COUNT)) break;
+		ring->first = (ring->first + 1) % SNAPSHOT_COUNT;
+		ring->count--;
+	}
+	struct SnapshotEntry *entry = &ring->entries[(ring->first + ring->count) % SNAPSHOT_COUNT];
+	entry->offset = ring->head;
+	entry->length = length;
+	entry->tick = tick;
+	ring->count++;
+	ring->head += length;
+	return ring->data + entry->offset;
+}
+
+/*! \brief Snapshot taken given number of snapshots ago, 0 being the latest; NULL when the ring doesn't reach that far. */
+const unsigned char* GetSnapshot(struct SnapshotRing *ring, int age, size_t *length, uint32_t *tick) {
+	if ((age < 0) || (age >= ring->count)) return NULL;
+	struct SnapshotEntry *entry = &ring->entries[(ring->first + ring->count - 1 - age) % SNAPSHOT_COUNT];
+	if (length) *length = entry->length;
+	if (tick) *tick = entry->tick;
+	return ring->data + entry->offset;
+}
+
+/*! \brief Forgets given number of the latest snapshots, e.g. after rewinding past them. */
+void DropSnapshots(struct SnapshotRing *ring, int count) {
+	if (count > ring->count) count = ring->count;
+	ring->count -= count;
+	if (ring->count) {
+		struct SnapshotEntry *latest = &ring->entries[(ring->first + ring->count - 1) % SNAPSHOT_COUNT];
+		ring->head = latest->offset + latest->length;
+	} else {
+		ring->head = 0;
+	}
+}
+
+/*! \brief FNV-1a of a snapshot, for finding the first tick where two runs diverge. */
+uint32_t HashSnapshot(const unsigned char *snapshot, size_t length) {
+	uint32_t hash = 2166136261u;
+	size_t i;
+	for (i=0; i<length; i++) {
+		hash = (hash ^ snapshot[i]) * 16777619u;
+	}
+	return hash;
+}
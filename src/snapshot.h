@@ -0,0 +1,30 @@
+#ifndef RADIOEDIT_SNAPSHOT_H
+#define RADIOEDIT_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SNAPSHOT_BYTES (256 * 1024)
+#define SNAPSHOT_COUNT 1024 /*!< Most snapshots kept, about 17 seconds at 60 ticks per second. */
+
+/*! \brief Ring of variable-sized state snapshots, dropping the oldest ones to make room. */
+struct SnapshotRing {
+	unsigned char *data;
+	size_t head; /*!< Where the next snapshot goes; snapshots are never split across the end. */
+	struct SnapshotEntry {
+		size_t offset, length;
+		uint32_t tick;
+	} *entries;
+	int first, count;
+};
+
+void InitSnapshotRing(struct SnapshotRing *ring);
+void DestroySnapshotRing(struct SnapshotRing *ring);
+void ClearSnapshots(struct SnapshotRing *ring);
+unsigned char* PushSnapshot(struct SnapshotRing *ring, uint32_t tick, size_t length);
+const unsigned char* GetSnapshot(struct SnapshotRing *ring, int age, size_t *length, uint32_t *tick);
+void DropSnapshots(struct SnapshotRing *ring, int count);
+uint32_t HashSnapshot(const unsigned char *snapshot, size_t length);
+
+#endif
@@ -0,0 +1,159 @@
+/*! \file spectrum.c
+ *  \brief Band levels of the mixed audio, for visuals following the music.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include <libsuperderpy.h>
+#include <math.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#define SPECTRUM_FRESH 4
+
+/*! \brief One radix-2 stage over split real/imaginary arrays, four butterflies at a time where possible. */
+static void Butterflies(float *re, float *im, const float *wr, const float *wi, int half) {
+	int k, j;
+	for (k=0; k<SPECTRUM_SIZE; k+=2*half) {
+		float *ar = re + k, *ai = im + k, *br = re + k + half, *bi = im + k + half;
+		j = 0;
+#ifdef __SSE__
+		for (; j+4<=half; j+=4) {
+			__m128 xr = _mm_loadu_ps(br + j), xi = _mm_loadu_ps(bi + j);
+			__m128 cr = _mm_loadu_ps(wr + j), ci = _mm_loadu_ps(wi + j);
+			__m128 tr = _mm_sub_ps(_mm_mul_ps(xr, cr), _mm_mul_ps(xi, ci));
+			__m128 ti = _mm_add_ps(_mm_mul_ps(xr, ci), _mm_mul_ps(xi, cr));
+			__m128 yr = _mm_loadu_ps(ar + j), yi = _mm_loadu_ps(ai + j);
+			_mm_storeu_ps(br + j, _mm_sub_ps(yr, tr));
+			_mm_storeu_ps(bi + j, _mm_sub_ps(yi, ti));
+			_mm_storeu_ps(ar + j, _mm_add_ps(yr, tr));
+			_mm_storeu_ps(ai + j, _mm_add_ps(yi, ti));
+		}
+#endif
+		for (; j<half; j++) {
+			float tr = br[j] * wr[j] - bi[j] * wi[j];
+			float ti = br[j] * wi[j] + bi[j] * wr[j];
+			br[j] = ar[j] - tr;
+			bi[j] = ai[j] - ti;
+			ar[j] += tr;
+			ai[j] += ti;
+		}
+	}
+}
+
+static void Analyze(struct SpectrumAnalyzer *a) {
+	int i, half;
+	// the oldest sample sits at the write position of the ring
+	for (i=0; i<SPECTRUM_SIZE; i++) {
+		int r = a->reverse[i];
+		a->re[r] = a->ring[(a->pos + i) % SPECTRUM_SIZE] * a->window[i];
+		a->im[r] = 0;
+	}
+	for (half=1; half<SPECTRUM_SIZE; half*=2) {
+		Butterflies(a->re, a->im, a->twiddle_re + half - 1, a->twiddle_im + half - 1, half);
+	}
+
+	float *bands = a->bands[a->back];
+	int band, bin = 1;
+	for (band=0; band<SPECTRUM_BANDS; band++) {
+		double energy = 0;
+		int end = (band == SPECTRUM_BANDS - 1) ? SPECTRUM_SIZE / 2 + 1 : bin * 2;
+		for (; bin<end; bin++) {
+			energy += a->re[bin] * a->re[bin] + a->im[bin] * a->im[bin];
+		}
+		// 0 at -60 dB, 1 at full scale sine
+		float level = 1 + log10(energy + 1e-12) / 6;
+		bands[band] = level < 0 ? 0 : (level > 1 ? 1 : level);
+	}
+	a->back = __atomic_exchange_n(&a->middle, a->back | SPECTRUM_FRESH, __ATOMIC_ACQ_REL) & ~SPECTRUM_FRESH;
+}
+
+static void CollectAudio(const float *buffer, unsigned int samples, int channels, void *userdata) {
+	struct SpectrumAnalyzer *a = userdata;
+	unsigned int i = 0;
+	int c;
+	// older samples would be overwritten in the ring anyway
+	if (samples > SPECTRUM_SIZE) i = samples - SPECTRUM_SIZE;
+	for (; i<samples; i++) {
+		float sum = 0;
+		for (c=0; c<channels; c++) {
+			sum += buffer[i * channels + c];
+		}
+		a->ring[a->pos] = sum / channels;
+		a->pos = (a->pos + 1) % SPECTRUM_SIZE;
+		a->pending++;
+	}
+	// only the latest window is analyzed, so the cost per buffer stays fixed
+	if (a->pending >= SPECTRUM_HOP) {
+		a->pending = 0;
+		Analyze(a);
+	}
+}
+
+struct SpectrumAnalyzer* CreateSpectrumAnalyzer(struct Game *game, ALLEGRO_MIXER *mixer) {
+	struct SpectrumAnalyzer *a = calloc(1, sizeof(struct SpectrumAnalyzer));
+	int i, bits = 0, half;
+	while ((1 << bits) < SPECTRUM_SIZE) bits++;
+	for (i=0; i<SPECTRUM_SIZE; i++) {
+		int b, r = 0;
+		for (b=0; b<bits; b++) {
+			if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+		}
+		a->reverse[i] = r;
+		// Hann window, scaled so that a full scale sine peaks at 1
+		a->window[i] = (1 - cos(2 * M_PI * i / SPECTRUM_SIZE)) / (SPECTRUM_SIZE / 2.0);
+	}
+	for (half=1; half<SPECTRUM_SIZE; half*=2) {
+		for (i=0; i<half; i++) {
+			a->twiddle_re[half - 1 + i] = cos(-M_PI * i / half);
+			a->twiddle_im[half - 1 + i] = sin(-M_PI * i / half);
+		}
+	}
+	a->back = 0;
+	a->middle = 1;
+	a->front = 2;
+	a->tap = AddAudioTap(game, mixer, CollectAudio, a);
+	if (!a->tap) {
+		free(a);
+		return NULL;
+	}
+	return a;
+}
+
+/*! \brief Removes the analyzer's tap and frees it; safe to call after DestroyGameData. */
+void DestroySpectrumAnalyzer(struct Game *game, struct SpectrumAnalyzer *analyzer) {
+	if (!analyzer) return;
+	RemoveAudioTap(game, analyzer->tap);
+	free(analyzer);
+}
+
+/*! \brief Copies the latest band levels, 0 to 1 on a logarithmic scale; returns whether they're new since last call. */
+bool ReadSpectrum(struct SpectrumAnalyzer *analyzer, float bands[SPECTRUM_BANDS]) {
+	if (!analyzer) {
+		memset(bands, 0, SPECTRUM_BANDS * sizeof(float));
+		return false;
+	}
+	bool fresh = __atomic_load_n(&analyzer->middle, __ATOMIC_ACQUIRE) & SPECTRUM_FRESH;
+	if (fresh) {
+		analyzer->front = __atomic_exchange_n(&analyzer->middle, analyzer->front, __ATOMIC_ACQ_REL) & ~SPECTRUM_FRESH;
+	}
+	memcpy(bands, analyzer->bands[analyzer->front], SPECTRUM_BANDS * sizeof(float));
+	return fresh;
+}
@@ -0,0 +1,36 @@
+#ifndef RADIOEDIT_SPECTRUM_H
+#define RADIOEDIT_SPECTRUM_H
+
+#include <allegro5/allegro_audio.h>
+
+#define SPECTRUM_SIZE 512 /*!< FFT length, must be a power of two. */
+#define SPECTRUM_HOP 256 /*!< New samples needed before the next analysis. */
+#define SPECTRUM_BANDS 8 /*!< Octave bands, from SPECTRUM_SIZE/2 bins down to the second one. */
+
+struct Game;
+struct AudioTap;
+
+/*! \brief FFT of a mixer's output running on the audio thread. */
+struct SpectrumAnalyzer {
+	struct AudioTap *tap;
+
+	// audio thread only
+	float ring[SPECTRUM_SIZE];
+	int pos, pending;
+	float re[SPECTRUM_SIZE], im[SPECTRUM_SIZE];
+	float window[SPECTRUM_SIZE];
+	float twiddle_re[SPECTRUM_SIZE], twiddle_im[SPECTRUM_SIZE]; /*!< Per stage of the FFT, stage with half-size h at offset h-1. */
+	unsigned short reverse[SPECTRUM_SIZE];
+	int back;
+
+	// lock-free triple buffer handing band levels over to the game thread
+	float bands[3][SPECTRUM_BANDS];
+	int middle; /*!< Slot shared between both sides, with SPECTRUM_FRESH set when it holds unread levels. */
+	int front; /*!< Game thread only. */
+};
+
+struct SpectrumAnalyzer* CreateSpectrumAnalyzer(struct Game *game, ALLEGRO_MIXER *mixer);
+void DestroySpectrumAnalyzer(struct Game *game, struct SpectrumAnalyzer *analyzer);
+bool ReadSpectrum(struct SpectrumAnalyzer *analyzer, float bands[SPECTRUM_BANDS]);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef RADIOEDIT_SPRITEMANIFEST_H
+#define RADIOEDIT_SPRITEMANIFEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*! \brief Source rectangle of a single animation frame. */
+struct SpriteFrame {
+	int x, y, w, h;
+};
+
+/*! \brief Spritesheet config compiled from data/sprites at build time. */
+struct SpriteManifestEntry {
+	const char *character;
+	const char *name;
+	int rows, cols, blanks;
+	double delay;
+	bool kill;
+	const char *successor;
+	int width, height; /*!< Size of a single frame. */
+	int frames_count;
+	const struct SpriteFrame *frames; /*!< Frame rectangles indexed by animation position. */
+};
+
+/*! \brief Generated by cmake/SpriteManifest.cmake, sorted by character and spritesheet name. */
+extern const struct SpriteManifestEntry sprite_manifest[];
+extern const int sprite_manifest_count;
+
+#endif
@@ -0,0 +1,146 @@
+/*! \file telemetry.c
+ *  \brief Gameplay metrics written to disk off the game thread.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Each run of the game writes one file, which tools/telemetry2csv turns
+// into CSV. The ring works like the ones of log.c, except that there's only
+// ever one producer, so it's a single ring with no registration.
+
+#include <stdio.h>
+#include <time.h>
+#include "common.h"
+#include <libsuperderpy.h>
+
+static int DrainTelemetry(struct Telemetry *telemetry) {
+	unsigned int tail = telemetry->tail, head = __atomic_load_n(&telemetry->head, __ATOMIC_ACQUIRE);
+	int count = head - tail;
+	while (tail != head) {
+		// the ring wraps at most once between tail and head, so it's written in up to two pieces
+		unsigned int start = tail % TELEMETRY_RING_SIZE, length = head - tail;
+		if (start + length > TELEMETRY_RING_SIZE) length = TELEMETRY_RING_SIZE - start;
+		telemetry->written += fwrite(&telemetry->records[start], sizeof(struct TelemetryRecord), length, telemetry->file);
+		tail += length;
+	}
+	__atomic_store_n(&telemetry->tail, tail, __ATOMIC_RELEASE);
+	return count;
+}
+
+static void* TelemetryThread(ALLEGRO_THREAD *thread, void *arg) {
+	struct Telemetry *telemetry = arg;
+	while (true) {
+		bool done = __atomic_load_n(&telemetry->done, __ATOMIC_ACQUIRE);
+		if (DrainTelemetry(telemetry)) {
+			fflush(telemetry->file);
+		}
+		if (done) break;
+		al_rest(TELEMETRY_INTERVAL);
+	}
+	return NULL;
+}
+
+static void WriteU32(FILE *f, uint32_t value) {
+	fwrite(&value, sizeof(uint32_t), 1, f);
+}
+
+struct Telemetry* CreateTelemetry(struct Game *game) {
+	char *dir = getenv("RADIOEDIT_TELEMETRY");
+	if (!dir || !dir[0]) return NULL;
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/telemetry-%ld%s", dir, (long)time(NULL), TELEMETRY_EXTENSION);
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		PrintConsole(game, "Can't write telemetry to %s.", path);
+		return NULL;
+	}
+	fwrite(TELEMETRY_MAGIC, 4, 1, file);
+	WriteU32(file, TELEMETRY_VERSION);
+	WriteU32(file, sizeof(struct TelemetryRecord));
+
+	struct Telemetry *telemetry = calloc(1, sizeof(struct Telemetry));
+	telemetry->file = file;
+	telemetry->path = strdup(path);
+	telemetry->thread = al_create_thread(TelemetryThread, telemetry);
+	al_start_thread(telemetry->thread);
+	PrintConsole(game, "Writing telemetry to %s.", telemetry->path);
+	return telemetry;
+}
+
+/*! \brief Writes out records still in the ring and closes the file. */
+void DestroyTelemetry(struct Game *game, struct Telemetry *telemetry) {
+	if (!telemetry) return;
+	__atomic_store_n(&telemetry->done, true, __ATOMIC_RELEASE);
+	al_join_thread(telemetry->thread, NULL);
+	al_destroy_thread(telemetry->thread);
+	fclose(telemetry->file);
+	PrintConsole(game, "Wrote %u telemetry records (%u dropped) over %d games to %s.",
+	             telemetry->written, telemetry->dropped, telemetry->session, telemetry->path);
+	free(telemetry->path);
+	free(telemetry);
+}
+
+static void PushRecord(struct Telemetry *telemetry, struct TelemetryRecord *record) {
+	unsigned int head = telemetry->head;
+	if (head - __atomic_load_n(&telemetry->tail, __ATOMIC_ACQUIRE) >= TELEMETRY_RING_SIZE) {
+		// the writer fell behind a whole ring; the game isn't going to wait for the disk
+		telemetry->dropped++;
+		return;
+	}
+	telemetry->records[head % TELEMETRY_RING_SIZE] = *record;
+	__atomic_store_n(&telemetry->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*! \brief Records given event; does nothing unless telemetry is enabled. Game thread only. */
+void RecordTelemetry(struct Game *game, enum TelemetryEvent event, uint32_t tick, int lane, int32_t a, int32_t b, int32_t c) {
+	struct Telemetry *telemetry = game->data->telemetry;
+	if (!telemetry || !telemetry->session) return;
+	struct TelemetryRecord record = { tick, telemetry->session, event, lane, a, b, c };
+	PushRecord(telemetry, &record);
+}
+
+/*! \brief Starts numbering records as a new game; unfinished frame windows of the previous one are thrown away. */
+void BeginTelemetrySession(struct Game *game, int lanes) {
+	struct Telemetry *telemetry = game->data->telemetry;
+	if (!telemetry) return;
+	telemetry->session++;
+	telemetry->last_frame = 0;
+	telemetry->frame_count = 0;
+	RecordTelemetry(game, TELEMETRY_SESSION, 0, 0, lanes, 0, 0);
+}
+
+static int CompareFrames(const void *a, const void *b) {
+	return *(const int32_t*)a - *(const int32_t*)b;
+}
+
+/*! \brief Counts the time since the previous frame, writing out percentiles once a window is full; call once per drawn gameplay frame. */
+void RecordTelemetryFrame(struct Game *game, uint32_t tick) {
+	struct Telemetry *telemetry = game->data->telemetry;
+	if (!telemetry || !telemetry->session) return;
+	double now = al_get_time(), interval = now - telemetry->last_frame;
+	bool counted = telemetry->last_frame && (interval < TELEMETRY_FRAME_GAP);
+	telemetry->last_frame = now;
+	if (!counted) return;
+
+	telemetry->frames[telemetry->frame_count++] = interval * 1000000;
+	if (telemetry->frame_count < TELEMETRY_FRAME_WINDOW) return;
+	telemetry->frame_count = 0;
+	qsort(telemetry->frames, TELEMETRY_FRAME_WINDOW, sizeof(int32_t), CompareFrames);
+	RecordTelemetry(game, TELEMETRY_FRAMES, tick, 0, telemetry->frames[TELEMETRY_FRAME_WINDOW / 2],
+	                telemetry->frames[TELEMETRY_FRAME_WINDOW * 90 / 100], telemetry->frames[TELEMETRY_FRAME_WINDOW * 99 / 100]);
+}
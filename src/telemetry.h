@@ -0,0 +1,82 @@
+#ifndef RADIOEDIT_TELEMETRY_H
+#define RADIOEDIT_TELEMETRY_H
+
+#include <stdint.h>
+
+#define TELEMETRY_MAGIC "RTEL"
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_EXTENSION ".rtel"
+
+/* Telemetry file: magic, then uint32 version and record size, followed by
+ * records until the end of the file. Everything is in the byte order of the
+ * machine that played; the version is there for the converter to notice. */
+
+/*! \brief What a record stands for; values a, b and c are described with each event. */
+enum TelemetryEvent {
+	TELEMETRY_SESSION, /*!< A game started; a is the lane count. */
+	TELEMETRY_SAMPLE, /*!< Periodic state; a is the score, b badguyRate, c badguySpeed in thousandths. */
+	TELEMETRY_HIT, /*!< A chord melted a badguy in lane; a is the points scored, b the marker position. */
+	TELEMETRY_MISS, /*!< A chord melted nothing in lane; b is the marker position. */
+	TELEMETRY_SOLO, /*!< A solo started; a is the score. */
+	TELEMETRY_BLAST, /*!< A solo ended; a is the badguys it melted, b the points scored. */
+	TELEMETRY_LOSS, /*!< A badguy reached the end of lane; a is the score, b its position, c its speed in thousandths. */
+	TELEMETRY_FRAMES, /*!< Frame intervals over the last window; a, b and c are the median, p90 and p99 in microseconds. */
+	TELEMETRY_EVENT_COUNT
+};
+
+/*! \brief Fixed size record, written out as it's laid out in memory. */
+struct TelemetryRecord {
+	uint32_t tick; /*!< Gameplay tick of the session. */
+	uint16_t session; /*!< Game within this run of the program, starting at 1. */
+	uint8_t event;
+	uint8_t lane;
+	int32_t a, b, c;
+};
+
+#ifndef RADIOEDIT_TELEMETRY_TOOL
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <allegro5/allegro.h>
+
+struct Game;
+
+#define TELEMETRY_RING_SIZE 4096 /*!< Records waiting for the writer, must be a power of two. */
+#define TELEMETRY_INTERVAL 0.25 /*!< Seconds the writer sleeps after emptying the ring. */
+#define TELEMETRY_SAMPLE_TICKS 60 /*!< Ticks between state samples. */
+#define TELEMETRY_FRAME_WINDOW 120 /*!< Frames summed up by one frame time record. */
+#define TELEMETRY_FRAME_GAP 0.25 /*!< Longer pauses between frames, e.g. from loading, aren't counted. */
+
+/*! \brief Gameplay metrics recorder, enabled by pointing RADIOEDIT_TELEMETRY to an existing directory.
+ *
+ * The game thread is the only producer of a single-producer single-consumer
+ * ring and never waits for the writer thread, which drains it to a file;
+ * records that don't fit are dropped and counted.
+ */
+struct Telemetry {
+	struct TelemetryRecord records[TELEMETRY_RING_SIZE];
+	unsigned int head; /*!< Written only by the game thread. */
+	unsigned int tail; /*!< Written only by the writer thread. */
+	unsigned int dropped;
+	bool done;
+
+	FILE *file;
+	char *path;
+	ALLEGRO_THREAD *thread;
+
+	uint16_t session;
+	double last_frame; /*!< When the previous frame was drawn, 0 at the start of a session. */
+	int32_t frames[TELEMETRY_FRAME_WINDOW]; /*!< Frame intervals of the current window in microseconds. */
+	int frame_count;
+	unsigned int written; /*!< Records written out, for the summary at exit. */
+};
+
+struct Telemetry* CreateTelemetry(struct Game *game);
+void DestroyTelemetry(struct Game *game, struct Telemetry *telemetry);
+void BeginTelemetrySession(struct Game *game, int lanes);
+void RecordTelemetry(struct Game *game, enum TelemetryEvent event, uint32_t tick, int lane, int32_t a, int32_t b, int32_t c);
+void RecordTelemetryFrame(struct Game *game, uint32_t tick);
+
+#endif
+
+#endif
@@ -0,0 +1,161 @@
+/*! \file trace.c
+ *  \brief Startup tracing in Chrome trace event format.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Tracing starts in main() before libsuperderpy and the game data exist,
+// so its state is kept here instead of in struct CommonResources.
+// Enable it by pointing RADIOEDIT_TRACE to the output file, then open
+// the file in chrome://tracing or any compatible viewer.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "trace.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define TRACE_MAX_EVENTS 1024
+
+struct TraceEvent {
+	char name[96];
+	char phase; /*!< 'B' - begin, 'E' - end, 'i' - instant. */
+	double timestamp; /*!< Microseconds since StartTrace. */
+};
+
+static struct {
+	bool enabled;
+	char *filename;
+	char drawn[32]; /*!< Gamestate which has drawn its first frame, but it's not on screen yet. */
+	char presented[32]; /*!< Last gamestate with its first frame on screen. */
+	double start;
+	int count;
+	struct TraceEvent events[TRACE_MAX_EVENTS];
+} trace;
+
+/*! \brief Monotonic clock in microseconds, cheap enough to call on hot paths. */
+double TraceClock(void) {
+#ifdef _WIN32
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return counter.QuadPart * 1000000.0 / frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+#endif
+}
+
+static void AddEvent(char phase, char* name) {
+	if (!trace.enabled || trace.count >= TRACE_MAX_EVENTS) return;
+	struct TraceEvent *event = &trace.events[trace.count++];
+	strncpy(event->name, name, sizeof(event->name)-1);
+	event->name[sizeof(event->name)-1] = 0;
+	event->phase = phase;
+	event->timestamp = TraceClock() - trace.start;
+}
+
+void StartTrace(void) {
+	char *filename = getenv("RADIOEDIT_TRACE");
+	if (!filename || !filename[0]) return;
+	trace.filename = strdup(filename);
+	trace.start = TraceClock();
+	trace.count = 0;
+	trace.enabled = true;
+	AddEvent('i', "main");
+}
+
+bool IsTracing(void) {
+	return trace.enabled;
+}
+
+void TraceBegin(char* name) {
+	AddEvent('B', name);
+}
+
+void TraceEnd(char* name) {
+	AddEvent('E', name);
+}
+
+void TraceInstant(char* name) {
+	AddEvent('i', name);
+}
+
+/*! \brief Marks the end of the first Gamestate_Draw of given gamestate. */
+void TraceFrameDrawn(char* gamestate) {
+	if (!trace.enabled || trace.drawn[0] || !strcmp(trace.presented, gamestate)) return;
+	char name[96];
+	snprintf(name, sizeof(name), "%s: first frame drawn", gamestate);
+	AddEvent('i', name);
+	strncpy(trace.drawn, gamestate, sizeof(trace.drawn)-1);
+}
+
+/*! \brief Called when a gamestate gets control again; the frame it drew last time has been flipped by then.
+ *
+ * libsuperderpy flips the display right after all gamestates are drawn and gives us
+ * no hook there, so this is an upper bound of the time of the first flip.
+ */
+void TraceFramePresented(char* gamestate, bool finish) {
+	if (!trace.enabled || strcmp(trace.drawn, gamestate)) return;
+	char name[96];
+	snprintf(name, sizeof(name), "%s: first frame presented", gamestate);
+	AddEvent('i', name);
+	strncpy(trace.presented, gamestate, sizeof(trace.presented)-1);
+	trace.drawn[0] = 0;
+	if (finish) {
+		FinishTrace();
+	}
+}
+
+static void WriteEscaped(FILE *file, char* str) {
+	for (; *str; str++) {
+		if ((*str == '"') || (*str == '\\')) fputc('\\', file);
+		fputc(*str, file);
+	}
+}
+
+/*! \brief Stops tracing and writes collected events out. */
+void FinishTrace(void) {
+	if (!trace.enabled) return;
+	trace.enabled = false;
+	FILE *file = fopen(trace.filename, "w");
+	if (!file) {
+		perror(trace.filename);
+	} else {
+		fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		int i;
+		for (i=0; i<trace.count; i++) {
+			fprintf(file, "{\"name\":\"");
+			WriteEscaped(file, trace.events[i].name);
+			fprintf(file, "\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":1%s}%s\n", trace.events[i].phase,
+			        trace.events[i].timestamp, trace.events[i].phase == 'i' ? ",\"s\":\"g\"" : "",
+			        i + 1 < trace.count ? "," : "");
+		}
+		fprintf(file, "]}\n");
+		fclose(file);
+		printf("Startup trace written to %s (%d events).\n", trace.filename, trace.count);
+	}
+	free(trace.filename);
+	trace.filename = NULL;
+}
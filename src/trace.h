@@ -0,0 +1,16 @@
+#ifndef RADIOEDIT_TRACE_H
+#define RADIOEDIT_TRACE_H
+
+#include <stdbool.h>
+
+void StartTrace(void);
+void TraceBegin(char* name);
+void TraceEnd(char* name);
+void TraceInstant(char* name);
+void TraceFrameDrawn(char* gamestate);
+void TraceFramePresented(char* gamestate, bool finish);
+void FinishTrace(void);
+bool IsTracing(void);
+double TraceClock(void);
+
+#endif
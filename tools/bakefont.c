@@ -0,0 +1,61 @@
+/*! \file bakefont.c
+ *  \brief Build tool pre-rasterizing TTF fonts into bitmap font atlases.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Usage: bakefont <font.ttf> <size> <output.png>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_font.h>
+#include <allegro5/allegro_ttf.h>
+#include <allegro5/allegro_image.h>
+#include <allegro5/allegro_primitives.h>
+#include "../src/fontbake.h"
+
+int main(int argc, char** argv) {
+	if (argc != 4) {
+		fprintf(stderr, "Usage: %s <font.ttf> <size> <output.png>\n", argv[0]);
+		return 1;
+	}
+	if (!al_init() || !al_init_image_addon() || !al_init_primitives_addon()) {
+		fprintf(stderr, "Failed to initialize Allegro!\n");
+		return 1;
+	}
+	al_init_font_addon();
+	al_init_ttf_addon();
+
+	// no display here, so everything is rendered in software
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+
+	ALLEGRO_FONT *font = al_load_ttf_font(argv[1], atoi(argv[2]), 0);
+	if (!font) {
+		fprintf(stderr, "Can't load %s!\n", argv[1]);
+		return 1;
+	}
+	ALLEGRO_BITMAP *atlas = BakeFontAtlas(font);
+	if (!atlas || !al_save_bitmap(argv[3], atlas)) {
+		fprintf(stderr, "Can't write %s!\n", argv[3]);
+		return 1;
+	}
+	al_destroy_bitmap(atlas);
+	al_destroy_font(font);
+	return 0;
+}
@@ -0,0 +1,186 @@
+/*! \file beatmap.c
+ *  \brief Build tool detecting beats of music tracks.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Usage: beatmap <track> <loop: 0|1> <output.beats>
+// Builds an onset envelope from energy rises, estimates the tempo from its
+// autocorrelation and the phase from a comb over it, then snaps every beat of
+// the resulting grid to the strongest nearby onset. Looping tracks get the
+// period adjusted so that a whole number of beats fits the loop.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_audio.h>
+#include <allegro5/allegro_acodec.h>
+#define RADIOEDIT_BEATMAP_TOOL
+#include "../src/beatmap.h"
+
+#define HOP 441 /* onset envelope resolution, 10 ms at 44.1 kHz */
+#define WINDOW 1024
+#define MIN_BPM 60
+#define MAX_BPM 180
+
+static void WriteU32(FILE *f, uint32_t value) {
+	unsigned char bytes[4] = { value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, (value >> 24) & 0xff };
+	fwrite(bytes, 4, 1, f);
+}
+
+static float* MixDown(ALLEGRO_SAMPLE *sample, unsigned int length) {
+	int channels = al_get_channel_count(al_get_sample_channels(sample));
+	ALLEGRO_AUDIO_DEPTH depth = al_get_sample_depth(sample);
+	if ((depth != ALLEGRO_AUDIO_DEPTH_INT16) && (depth != ALLEGRO_AUDIO_DEPTH_FLOAT32)) return NULL;
+	float *mono = calloc(length, sizeof(float));
+	const void *data = al_get_sample_data(sample);
+	unsigned int i;
+	int c;
+	for (i=0; i<length; i++) {
+		for (c=0; c<channels; c++) {
+			if (depth == ALLEGRO_AUDIO_DEPTH_INT16) {
+				mono[i] += ((const int16_t*)data)[i * channels + c] / 32768.0;
+			} else {
+				mono[i] += ((const float*)data)[i * channels + c];
+			}
+		}
+		mono[i] /= channels;
+	}
+	return mono;
+}
+
+/*! \brief Half-wave rectified rise of log energy, one value per HOP samples. */
+static float* OnsetEnvelope(const float *mono, unsigned int length, int *frames) {
+	*frames = length / HOP;
+	float *onset = calloc(*frames, sizeof(float));
+	double previous = 0;
+	int n;
+	for (n=0; n<*frames; n++) {
+		double energy = 0;
+		unsigned int i;
+		for (i=n*HOP; (i<n*HOP+WINDOW) && (i<length); i++) {
+			energy += mono[i] * mono[i];
+		}
+		energy = log(energy + 1e-6);
+		if (n && (energy > previous)) onset[n] = energy - previous;
+		previous = energy;
+	}
+	return onset;
+}
+
+static double CombScore(const float *onset, int frames, double period, double phase) {
+	double score = 0, t;
+	for (t=phase; t<frames; t+=period) {
+		score += onset[(int)t];
+	}
+	return score;
+}
+
+int main(int argc, char** argv) {
+	if (argc != 4) {
+		fprintf(stderr, "Usage: %s <track> <loop> <output.beats>\n", argv[0]);
+		return 1;
+	}
+	if (!al_init() || !al_init_acodec_addon()) {
+		fprintf(stderr, "Failed to initialize Allegro!\n");
+		return 1;
+	}
+	ALLEGRO_SAMPLE *sample = al_load_sample(argv[1]);
+	if (!sample) {
+		fprintf(stderr, "Can't load %s!\n", argv[1]);
+		return 1;
+	}
+	unsigned int length = al_get_sample_length(sample), rate = al_get_sample_frequency(sample);
+	float *mono = MixDown(sample, length);
+	if (!mono) {
+		fprintf(stderr, "Unsupported sample format of %s!\n", argv[1]);
+		return 1;
+	}
+	int frames, n;
+	float *onset = OnsetEnvelope(mono, length, &frames);
+	free(mono);
+
+	// tempo: the autocorrelation peak within the allowed range
+	int min_lag = rate * 60 / MAX_BPM / HOP, max_lag = rate * 60 / MIN_BPM / HOP, lag, best_lag = 0;
+	double best = -1;
+	for (lag=min_lag; (lag<=max_lag) && (lag<frames); lag++) {
+		double sum = 0;
+		for (n=lag; n<frames; n++) {
+			sum += onset[n] * onset[n - lag];
+		}
+		if (sum > best) {
+			best = sum;
+			best_lag = lag;
+		}
+	}
+	double period = best_lag ? (double)best_lag * HOP : (double)BEATMAP_DEFAULT_PERIOD;
+	if (atoi(argv[2])) {
+		int beats = (int)floor(length / period + 0.5);
+		if (beats < 1) beats = 1;
+		period = (double)length / beats;
+	}
+
+	// phase: the grid offset collecting the most onset energy
+	double phase = 0, step = period / HOP;
+	best = -1;
+	for (n=0; n<(int)ceil(step); n++) {
+		double score = CombScore(onset, frames, step, n);
+		if (score > best) {
+			best = score;
+			phase = n;
+		}
+	}
+
+	int count = 0, capacity = (int)(length / period) + 2;
+	uint32_t *beats = malloc(capacity * sizeof(uint32_t));
+	double t;
+	int window = (int)(step / 8);
+	for (t=phase; (t<frames) && (count<capacity); t+=step) {
+		int center = (int)t, peak = center;
+		for (n=center-window; n<=center+window; n++) {
+			if ((n >= 0) && (n < frames) && (onset[n] > onset[peak])) peak = n;
+		}
+		// the rise shows up in the first window reaching the onset, so it lies near the window's end
+		uint32_t position = (uint32_t)peak * HOP + WINDOW - HOP / 2;
+		if ((position < length) && (!count || (position > beats[count - 1]))) {
+			beats[count++] = position;
+		}
+	}
+
+	FILE *out = fopen(argv[3], "wb");
+	if (!out) {
+		fprintf(stderr, "Can't write %s!\n", argv[3]);
+		return 1;
+	}
+	fwrite(BEATMAP_MAGIC, 4, 1, out);
+	WriteU32(out, rate);
+	WriteU32(out, length);
+	WriteU32(out, count);
+	for (n=0; n<count; n++) {
+		WriteU32(out, beats[n]);
+	}
+	fclose(out);
+	printf("%s: %.1f BPM, %d beats.\n", argv[1], 60.0 * rate / period, count);
+
+	free(beats);
+	free(onset);
+	al_destroy_sample(sample);
+	return 0;
+}
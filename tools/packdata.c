@@ -0,0 +1,127 @@
+/*! \file packdata.c
+ *  \brief Build tool packing game data into a single indexed archive.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Usage: packdata <output.pak> <data directory> <file>... [-C <directory> <file>...]
+// File names are stored relative to the data directory, exactly as passed.
+// Like with tar, -C changes the directory following files are read from,
+// which is how files generated in the build tree get packed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define RADIOEDIT_PACK_TOOL
+#include "../src/archive.h"
+
+struct InputFile {
+	char *dir;
+	char *name;
+};
+
+static int CompareNames(const void *a, const void *b) {
+	return strcmp(((const struct InputFile*)a)->name, ((const struct InputFile*)b)->name);
+}
+
+static void WriteU32(unsigned char *dst, uint32_t value) {
+	dst[0] = value & 0xff;
+	dst[1] = (value >> 8) & 0xff;
+	dst[2] = (value >> 16) & 0xff;
+	dst[3] = (value >> 24) & 0xff;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 4) {
+		fprintf(stderr, "Usage: %s <output> <datadir> <file>... [-C <dir> <file>...]\n", argv[0]);
+		return 1;
+	}
+
+	struct InputFile *files = calloc(argc, sizeof(struct InputFile));
+	char *dir = argv[2];
+	int count = 0, i;
+	for (i=3; i<argc; i++) {
+		if (!strcmp(argv[i], "-C") && (i+1 < argc)) {
+			dir = argv[++i];
+			continue;
+		}
+		files[count].dir = dir;
+		files[count].name = argv[i];
+		count++;
+	}
+	qsort(files, count, sizeof(struct InputFile), CompareNames);
+
+	FILE *out = fopen(argv[1], "wb");
+	if (!out) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	unsigned char header[sizeof(struct ArchiveHeader)] = {0};
+	memcpy(header, ARCHIVE_MAGIC, 4);
+	WriteU32(header + 4, ARCHIVE_VERSION);
+	WriteU32(header + 8, count);
+	fwrite(header, sizeof(header), 1, out);
+
+	size_t index_size = count * sizeof(struct ArchiveEntry);
+	unsigned char *index = calloc(1, index_size);
+	fwrite(index, index_size, 1, out); // filled in once offsets are known
+
+	uint32_t offset = sizeof(header) + index_size;
+	for (i=0; i<count; i++) {
+		if (strlen(files[i].name) >= ARCHIVE_NAME_LENGTH) {
+			fprintf(stderr, "%s: name too long\n", files[i].name);
+			return 1;
+		}
+		while (offset % ARCHIVE_ALIGNMENT) {
+			fputc(0, out);
+			offset++;
+		}
+
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", files[i].dir, files[i].name);
+		FILE *in = fopen(path, "rb");
+		if (!in) {
+			perror(path);
+			return 1;
+		}
+		uint32_t size = 0;
+		char buffer[65536];
+		size_t n;
+		while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+			fwrite(buffer, 1, n, out);
+			size += n;
+		}
+		fclose(in);
+
+		unsigned char *entry = index + i * sizeof(struct ArchiveEntry);
+		strncpy((char*)entry, files[i].name, ARCHIVE_NAME_LENGTH);
+		WriteU32(entry + ARCHIVE_NAME_LENGTH, offset);
+		WriteU32(entry + ARCHIVE_NAME_LENGTH + 4, size);
+		offset += size;
+	}
+
+	fseek(out, sizeof(header), SEEK_SET);
+	fwrite(index, index_size, 1, out);
+	fclose(out);
+	free(index);
+	free(files);
+
+	printf("Packed %d files (%u bytes) into %s\n", count, offset, argv[1]);
+	return 0;
+}
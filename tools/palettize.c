@@ -0,0 +1,137 @@
+/*! \file palettize.c
+ *  \brief Build tool converting pixel-art PNGs to indices into a shared palette.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Usage: palettize <data directory> <output directory> <file.png>...
+// Writes palette.pal and an .idx file next to each given PNG into the output
+// directory. Files are added to the palette in the order given, so the ones
+// which matter the most should come first; images whose colors don't fit
+// anymore get an empty .idx and keep being loaded from their PNGs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_image.h>
+#define RADIOEDIT_PALETTE_TOOL
+#include "../src/palette.h"
+
+static unsigned char palette[PALETTE_SIZE][4];
+static int count = 1; // color 0 stays transparent
+
+static void WriteU32(FILE *f, uint32_t value) {
+	unsigned char bytes[4] = { value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, (value >> 24) & 0xff };
+	fwrite(bytes, 4, 1, f);
+}
+
+static int FindColor(unsigned char (*colors)[4], int n, const unsigned char *color) {
+	if (color[3] == 0) return 0;
+	int i;
+	for (i=1; i<n; i++) {
+		if (!memcmp(colors[i], color, 4)) return i;
+	}
+	return -1;
+}
+
+/*! \brief Maps every pixel to the palette, extending it; returns false when the colors don't fit. */
+static bool IndexBitmap(ALLEGRO_BITMAP *bitmap, unsigned char *indices) {
+	int width = al_get_bitmap_width(bitmap), height = al_get_bitmap_height(bitmap);
+	ALLEGRO_LOCKED_REGION *region = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY);
+	if (!region) return false;
+	int extended = count, x, y;
+	for (y=0; y<height; y++) {
+		const unsigned char *row = (const unsigned char*)region->data + y * region->pitch;
+		for (x=0; x<width; x++) {
+			int index = FindColor(palette, extended, row + x * 4);
+			if (index < 0) {
+				if (extended == PALETTE_SIZE) {
+					al_unlock_bitmap(bitmap);
+					return false;
+				}
+				index = extended++;
+				memcpy(palette[index], row + x * 4, 4);
+			}
+			indices[y * width + x] = index;
+		}
+	}
+	al_unlock_bitmap(bitmap);
+	count = extended;
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 4) {
+		fprintf(stderr, "Usage: %s <datadir> <outdir> <file.png>...\n", argv[0]);
+		return 1;
+	}
+	if (!al_init() || !al_init_image_addon()) {
+		fprintf(stderr, "Failed to initialize Allegro!\n");
+		return 1;
+	}
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+
+	int i;
+	for (i=3; i<argc; i++) {
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", argv[1], argv[i]);
+		// keep straight alpha, the game premultiplies palette colors on its own
+		ALLEGRO_BITMAP *bitmap = al_load_bitmap_flags(path, ALLEGRO_NO_PREMULTIPLIED_ALPHA);
+		if (!bitmap) {
+			fprintf(stderr, "Can't load %s!\n", path);
+			return 1;
+		}
+		int width = al_get_bitmap_width(bitmap), height = al_get_bitmap_height(bitmap);
+		unsigned char *indices = malloc((size_t)width * height);
+		if (!IndexBitmap(bitmap, indices)) {
+			fprintf(stderr, "%s doesn't fit into the palette, leaving it as RGBA.\n", argv[i]);
+			width = 0;
+			height = 0;
+		}
+		al_destroy_bitmap(bitmap);
+
+		char *ext = strrchr(argv[i], '.');
+		snprintf(path, sizeof(path), "%s/%.*s%s", argv[2], ext ? (int)(ext - argv[i]) : (int)strlen(argv[i]), argv[i], INDEXED_EXTENSION);
+		FILE *out = fopen(path, "wb");
+		if (!out) {
+			fprintf(stderr, "Can't write %s!\n", path);
+			return 1;
+		}
+		fwrite(INDEXED_MAGIC, 4, 1, out);
+		WriteU32(out, width);
+		WriteU32(out, height);
+		fwrite(indices, 1, (size_t)width * height, out);
+		fclose(out);
+		free(indices);
+	}
+
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s", argv[2], PALETTE_FILENAME);
+	FILE *out = fopen(path, "wb");
+	if (!out) {
+		fprintf(stderr, "Can't write %s!\n", path);
+		return 1;
+	}
+	fwrite(PALETTE_MAGIC, 4, 1, out);
+	WriteU32(out, count);
+	fwrite(palette, 4, count, out);
+	fclose(out);
+	printf("Palette has %d colors.\n", count);
+	return 0;
+}
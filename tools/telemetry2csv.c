@@ -0,0 +1,142 @@
+/*! \file telemetry2csv.c
+ *  \brief Tool converting gameplay telemetry files to CSV.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Usage: telemetry2csv <telemetry.rtel> [event]
+// Prints every record as a CSV row to stdout. Without an event name the rows
+// of all events share generic value columns; with one, only that event is
+// printed, with its values named and scaled to seconds, milliseconds and
+// plain speeds, ready for a spreadsheet.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define RADIOEDIT_TELEMETRY_TOOL
+#include "../src/telemetry.h"
+
+#define TICKS_PER_SECOND 60.0
+
+/*! \brief Name of each event and its values; NULL values aren't printed, scales divide them. */
+static const struct {
+	const char *name;
+	const char *values[3];
+	double scales[3];
+} events[TELEMETRY_EVENT_COUNT] = {
+	[TELEMETRY_SESSION] = { "session", { "lanes", NULL, NULL }, { 1, 1, 1 } },
+	[TELEMETRY_SAMPLE] = { "sample", { "score", "badguy_rate", "badguy_speed" }, { 1, 1, 1000 } },
+	[TELEMETRY_HIT] = { "hit", { "points", "marker_x", NULL }, { 1, 1, 1 } },
+	[TELEMETRY_MISS] = { "miss", { NULL, "marker_x", NULL }, { 1, 1, 1 } },
+	[TELEMETRY_SOLO] = { "solo", { "score", NULL, NULL }, { 1, 1, 1 } },
+	[TELEMETRY_BLAST] = { "blast", { "melted", "points", NULL }, { 1, 1, 1 } },
+	[TELEMETRY_LOSS] = { "loss", { "score", "badguy_x", "badguy_speed" }, { 1, 1, 1000 } },
+	[TELEMETRY_FRAMES] = { "frames", { "median_ms", "p90_ms", "p99_ms" }, { 1000, 1000, 1000 } },
+};
+
+static int FindEvent(const char *name) {
+	int i;
+	for (i=0; i<TELEMETRY_EVENT_COUNT; i++) {
+		if (!strcmp(events[i].name, name)) return i;
+	}
+	return -1;
+}
+
+static void PrintValue(int32_t value, double scale) {
+	if (scale == 1) {
+		printf(",%d", value);
+	} else {
+		printf(",%g", value / scale);
+	}
+}
+
+int main(int argc, char **argv) {
+	if ((argc < 2) || (argc > 3)) {
+		fprintf(stderr, "Usage: %s <telemetry%s> [event]\n", argv[0], TELEMETRY_EXTENSION);
+		return 1;
+	}
+	int filter = -1;
+	if (argc == 3) {
+		filter = FindEvent(argv[2]);
+		if (filter < 0) {
+			fprintf(stderr, "Unknown event %s.\n", argv[2]);
+			return 1;
+		}
+	}
+
+	FILE *f = fopen(argv[1], "rb");
+	if (!f) {
+		fprintf(stderr, "Can't open %s.\n", argv[1]);
+		return 1;
+	}
+	char magic[4];
+	uint32_t version, size;
+	if ((fread(magic, 4, 1, f) != 1) || memcmp(magic, TELEMETRY_MAGIC, 4) ||
+	    (fread(&version, sizeof(uint32_t), 1, f) != 1) || (fread(&size, sizeof(uint32_t), 1, f) != 1)) {
+		fprintf(stderr, "%s isn't a telemetry file.\n", argv[1]);
+		fclose(f);
+		return 1;
+	}
+	if ((version != TELEMETRY_VERSION) || (size != sizeof(struct TelemetryRecord))) {
+		// a byte-swapped version lands here too
+		fprintf(stderr, "%s has version %u with %u byte records, expected %d with %zu.\n", argv[1], version, size,
+		        TELEMETRY_VERSION, sizeof(struct TelemetryRecord));
+		fclose(f);
+		return 1;
+	}
+
+	int i;
+	printf("session,tick,seconds");
+	if (filter < 0) {
+		printf(",event,lane,a,b,c\n");
+	} else {
+		printf(",lane");
+		for (i=0; i<3; i++) {
+			if (events[filter].values[i]) printf(",%s", events[filter].values[i]);
+		}
+		printf("\n");
+	}
+
+	struct TelemetryRecord record;
+	unsigned int count = 0, skipped = 0;
+	while (fread(&record, sizeof(record), 1, f) == 1) {
+		if (record.event >= TELEMETRY_EVENT_COUNT) {
+			skipped++;
+			continue;
+		}
+		if ((filter >= 0) && (record.event != filter)) continue;
+		printf("%u,%u,%.3f", record.session, record.tick, record.tick / TICKS_PER_SECOND);
+		if (filter < 0) {
+			printf(",%s,%u,%d,%d,%d\n", events[record.event].name, record.lane, record.a, record.b, record.c);
+		} else {
+			int32_t values[3] = { record.a, record.b, record.c };
+			printf(",%u", record.lane);
+			for (i=0; i<3; i++) {
+				if (events[filter].values[i]) PrintValue(values[i], events[filter].scales[i]);
+			}
+			printf("\n");
+		}
+		count++;
+	}
+	fclose(f);
+	fprintf(stderr, "%u records converted.\n", count);
+	if (skipped) {
+		fprintf(stderr, "%u records of unknown events skipped.\n", skipped);
+	}
+	return 0;
+}